@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+#
+#  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+"""Stand-ins for the services gooroom-autostart-program talks to.
+
+Runs on the buses named by DBUS_SESSION_BUS_ADDRESS and
+DBUS_SYSTEM_BUS_ADDRESS, which login_bench.py points at private
+dbus-daemons. Prints "ready" once every name is owned.
+
+  system bus:  kr.gooroom.agent, org.freedesktop.systemd1,
+               org.freedesktop.PolicyKit1
+  session bus: org.xfce.Xfconf, org.xfce.Panel
+"""
+
+import json
+import sys
+
+from gi.repository import Gio, GLib
+
+AGENT_XML = """
+<node>
+  <interface name="kr.gooroom.agent">
+    <method name="do_task">
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="v"/>
+    </method>
+    <signal name="dpms_on_x_off"><arg type="i"/></signal>
+    <signal name="update_operation"><arg type="i"/></signal>
+    <signal name="app_black_list"><arg type="v"/></signal>
+  </interface>
+</node>
+"""
+
+SYSTEMD_XML = """
+<node>
+  <interface name="org.freedesktop.systemd1.Manager">
+    <method name="GetUnit">
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="o"/>
+    </method>
+    <method name="ReloadUnit">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="o"/>
+    </method>
+    <method name="Subscribe"/>
+  </interface>
+  <interface name="org.freedesktop.systemd1.Unit">
+    <property name="ActiveState" type="s" access="read"/>
+  </interface>
+</node>
+"""
+
+POLKIT_XML = """
+<node>
+  <interface name="org.freedesktop.PolicyKit1.Authority">
+    <method name="CheckAuthorization">
+      <arg direction="in" type="(sa{sv})"/>
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="a{ss}"/>
+      <arg direction="in" type="u"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="(bba{ss})"/>
+    </method>
+    <method name="CancelCheckAuthorization">
+      <arg direction="in" type="s"/>
+    </method>
+    <signal name="Changed"/>
+    <property name="BackendName" type="s" access="read"/>
+    <property name="BackendVersion" type="s" access="read"/>
+    <property name="BackendFeatures" type="u" access="read"/>
+  </interface>
+</node>
+"""
+
+XFCONF_XML = """
+<node>
+  <interface name="org.xfce.Xfconf">
+    <method name="SetProperty">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="v"/>
+    </method>
+    <method name="GetProperty">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="v"/>
+    </method>
+    <method name="GetAllProperties">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="a{sv}"/>
+    </method>
+    <method name="PropertyExists">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="b"/>
+    </method>
+    <method name="ResetProperty">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="b"/>
+    </method>
+    <method name="ListChannels">
+      <arg direction="out" type="as"/>
+    </method>
+    <method name="IsPropertyLocked">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="b"/>
+    </method>
+    <signal name="PropertyChanged">
+      <arg type="s"/><arg type="s"/><arg type="v"/>
+    </signal>
+    <signal name="PropertyRemoved">
+      <arg type="s"/><arg type="s"/>
+    </signal>
+  </interface>
+</node>
+"""
+
+GRAC_UNIT_PATH = "/org/freedesktop/systemd1/unit/grac_2ddevice_2ddaemon_2eservice"
+
+
+class FakeServices:
+    def __init__(self, monitors):
+        self.counters = {}
+        self.xfconf = {
+            "xfce4-desktop": {},
+            "xsettings": {},
+            "xfce4-power-manager": {},
+        }
+        for i in range(monitors):
+            base = "/backdrop/screen0/monitor%d/workspace0" % i
+            self.xfconf["xfce4-desktop"][base + "/last-image"] = GLib.Variant("s", "")
+            self.xfconf["xfce4-desktop"][base + "/image-style"] = GLib.Variant("i", 5)
+        self.pending_names = 0
+
+    def count(self, name):
+        self.counters[name] = self.counters.get(name, 0) + 1
+
+    # kr.gooroom.agent
+
+    def agent_call(self, conn, sender, path, iface, method, params, invocation):
+        self.count("agent." + method)
+        task = json.loads(params.unpack()[0])["module"]["task"]["task_name"]
+        out = {"status": "200"}
+        if task == "dpms_off_time":
+            out["screen_time"] = "10"
+        elif task == "get_app_list":
+            out["black_list"] = "bench-blocked-a,bench-blocked-b"
+        reply = json.dumps({"module": {"task": {"task_name": task, "out": out}}})
+        invocation.return_value(GLib.Variant("(v)", (GLib.Variant("s", reply),)))
+
+    # org.freedesktop.systemd1
+
+    def systemd_call(self, conn, sender, path, iface, method, params, invocation):
+        self.count("systemd." + method)
+        if method in ("GetUnit", "ReloadUnit"):
+            invocation.return_value(GLib.Variant("(o)", (GRAC_UNIT_PATH,)))
+        else:
+            invocation.return_value(None)
+
+    def systemd_get_property(self, conn, sender, path, iface, prop):
+        return GLib.Variant("s", "active")
+
+    # org.freedesktop.PolicyKit1
+
+    def polkit_call(self, conn, sender, path, iface, method, params, invocation):
+        self.count("polkit." + method)
+        if method == "CheckAuthorization":
+            invocation.return_value(GLib.Variant("((bba{ss}))", ((True, False, {}),)))
+        else:
+            invocation.return_value(None)
+
+    def polkit_get_property(self, conn, sender, path, iface, prop):
+        if prop == "BackendFeatures":
+            return GLib.Variant("u", 0)
+        return GLib.Variant("s", "bench")
+
+    # org.xfce.Xfconf
+
+    def xfconf_call(self, conn, sender, path, iface, method, params, invocation):
+        self.count("xfconf." + method)
+        args = params.unpack()
+        if method == "ListChannels":
+            invocation.return_value(GLib.Variant("(as)", (list(self.xfconf),)))
+            return
+
+        channel = self.xfconf.setdefault(args[0], {})
+        prop = args[1]
+
+        if method == "SetProperty":
+            value = params.get_child_value(2).get_variant()
+            channel[prop] = value
+            conn.emit_signal(None, path, iface, "PropertyChanged",
+                             GLib.Variant("(ssv)", (args[0], prop, value)))
+            invocation.return_value(None)
+        elif method == "GetProperty":
+            if prop in channel:
+                invocation.return_value(GLib.Variant("(v)", (channel[prop],)))
+            else:
+                invocation.return_dbus_error("org.xfce.Xfconf.Error.PropertyNotFound",
+                                             "Property \"%s\" does not exist" % prop)
+        elif method == "GetAllProperties":
+            props = {k: v for k, v in channel.items()
+                     if prop in ("", "/") or k == prop or k.startswith(prop + "/")}
+            invocation.return_value(GLib.Variant("(a{sv})", (props,)))
+        elif method == "PropertyExists":
+            invocation.return_value(GLib.Variant("(b)", (prop in channel,)))
+        elif method == "ResetProperty":
+            channel.pop(prop, None)
+            invocation.return_value(None)
+        else:
+            invocation.return_value(GLib.Variant("(b)", (False,)))
+
+    def export(self, conn, xml, path, call, get_property=None):
+        for iface in Gio.DBusNodeInfo.new_for_xml(xml).interfaces:
+            conn.register_object(path, iface, call, get_property, None)
+
+    def own(self, bus_type, name):
+        self.pending_names += 1
+        Gio.bus_own_name(bus_type, name, Gio.BusNameOwnerFlags.NONE,
+                         None, self.name_acquired, self.name_lost)
+
+    def name_acquired(self, conn, name):
+        self.pending_names -= 1
+        if self.pending_names == 0:
+            print("ready", flush=True)
+
+    def name_lost(self, conn, name):
+        print("could not own %s" % name, file=sys.stderr, flush=True)
+        sys.exit(1)
+
+    def start(self):
+        system = Gio.bus_get_sync(Gio.BusType.SYSTEM, None)
+        session = Gio.bus_get_sync(Gio.BusType.SESSION, None)
+
+        self.export(system, AGENT_XML, "/kr/gooroom/agent", self.agent_call)
+        self.export(system, SYSTEMD_XML, "/org/freedesktop/systemd1", self.systemd_call)
+        self.export(system, SYSTEMD_XML, GRAC_UNIT_PATH, self.systemd_call,
+                    self.systemd_get_property)
+        self.export(system, POLKIT_XML, "/org/freedesktop/PolicyKit1/Authority",
+                    self.polkit_call, self.polkit_get_property)
+        self.export(session, XFCONF_XML, "/org/xfce/Xfconf", self.xfconf_call)
+
+        self.own(Gio.BusType.SYSTEM, "kr.gooroom.agent")
+        self.own(Gio.BusType.SYSTEM, "org.freedesktop.systemd1")
+        self.own(Gio.BusType.SYSTEM, "org.freedesktop.PolicyKit1")
+        self.own(Gio.BusType.SESSION, "org.xfce.Xfconf")
+        self.own(Gio.BusType.SESSION, "org.xfce.Panel")
+
+
+def main():
+    monitors = int(sys.argv[1]) if len(sys.argv) > 1 else 1
+    services = FakeServices(monitors)
+    services.start()
+    GLib.MainLoop().run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,388 @@
+#!/usr/bin/env python3
+#
+#  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+"""End-to-end login benchmark for gooroom-autostart-program.
+
+Each run gets a scratch HOME and XDG_RUNTIME_DIR, private session and
+system dbus-daemons with the stand-ins from fake_services.py, a local
+HTTP server for favicons and the wallpaper, and a generated .grm-user
+with N apps, passed with --config. The program's own timing record
+($XDG_RUNTIME_DIR/gooroom/autostart-timing.json) marks the end of the
+login; the process is then stopped and measured.
+
+Reported per N: wall time until the record, the login phases, forks
+(with strace), bytes read and written, and peak RSS.
+
+  make bench
+  bench/login_bench.py --binary src/gooroom-autostart-program -n 1 -n 50 -n 500
+
+Needs python3-gi, dbus-daemon and an X display (xvfb-run is used when
+DISPLAY is unset). libnss_wrapper, when installed, makes the current
+user look like an online account so the desktop phases run as well.
+"""
+
+import argparse
+import http.server
+import json
+import os
+import shutil
+import signal
+import socketserver
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+DBUS_CONFIG = """<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-BUS Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>{type}</type>
+  <listen>unix:tmpdir={dir}</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+    <allow own="*"/>
+  </policy>
+</busconfig>
+"""
+
+NSS_WRAPPER_PATHS = (
+    "/usr/lib/x86_64-linux-gnu/libnss_wrapper.so",
+    "/usr/lib/libnss_wrapper.so",
+    "/usr/lib64/libnss_wrapper.so",
+)
+
+# commands the program spawns that must not touch the real desktop
+STUB_COMMANDS = ("xfce4-panel", "pkill", "xfce4-session-logout", "gooroom-update-launcher")
+
+
+def png(width, height, rgb):
+    """A solid-colour RGB PNG, small enough to build in memory."""
+    row = b"\x00" + bytes(rgb) * width
+    raw = zlib.compress(row * height, 9)
+
+    def chunk(tag, data):
+        body = tag + data
+        return struct.pack(">I", len(data)) + body + struct.pack(">I", zlib.crc32(body))
+
+    return (b"\x89PNG\r\n\x1a\n" +
+            chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)) +
+            chunk(b"IDAT", raw) +
+            chunk(b"IEND", b""))
+
+
+class AssetServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+
+def start_asset_server(root):
+    handler = lambda *args: http.server.SimpleHTTPRequestHandler(*args, directory=root)
+    http.server.SimpleHTTPRequestHandler.log_message = lambda *args: None
+    server = AssetServer(("127.0.0.1", 0), handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def write_assets(root, n_apps):
+    os.makedirs(root, exist_ok=True)
+    with open(os.path.join(root, "wallpaper.png"), "wb") as f:
+        f.write(png(3840, 2160, (32, 64, 128)))
+    for i in range(n_apps):
+        with open(os.path.join(root, "favicon-%d.png" % i), "wb") as f:
+            f.write(png(32, 32, (i % 256, 128, 255 - i % 256)))
+
+
+def write_grm_user(path, user, base_url, n_apps):
+    apps = []
+    for i in range(n_apps):
+        apps.append({
+            "position": "bar" if i % 2 == 0 else "menu",
+            "desktop": {
+                "name": "Bench App %d" % i,
+                "comment": "Benchmark launcher %d" % i,
+                "exec": "xdg-open https://example.com/%d" % i,
+                "icon": "%s/favicon-%d.png" % (base_url, i),
+            },
+        })
+
+    data = {
+        "data": {
+            "loginInfo": {"user_id": user},
+            "desktopInfo": {
+                "themeNm": "bench-theme",
+                "wallpaperNm": "bench-wallpaper.png",
+                "wallpaperFile": "%s/wallpaper.png" % base_url,
+                "apps": apps,
+            },
+        },
+    }
+
+    os.makedirs(os.path.dirname(path), mode=0o700, exist_ok=True)
+    with open(path, "w") as f:
+        json.dump(data, f)
+
+
+def write_stubs(bin_dir, counter_dir):
+    os.makedirs(bin_dir, exist_ok=True)
+    for name in STUB_COMMANDS:
+        stub = os.path.join(bin_dir, name)
+        with open(stub, "w") as f:
+            f.write("#!/bin/sh\necho \"$0 $*\" >> %s/%s\nexit 0\n"
+                    % (counter_dir, name))
+        os.chmod(stub, 0o755)
+
+
+def start_bus(tmp, bus_type):
+    config = os.path.join(tmp, "%s-bus.conf" % bus_type)
+    with open(config, "w") as f:
+        f.write(DBUS_CONFIG.format(type=bus_type, dir=tmp))
+
+    proc = subprocess.Popen(["dbus-daemon", "--nofork", "--print-address=1",
+                             "--config-file=" + config],
+                            stdout=subprocess.PIPE, universal_newlines=True)
+    address = proc.stdout.readline().strip()
+    if not address:
+        raise RuntimeError("dbus-daemon did not start")
+    return proc, address
+
+
+def read_proc(pid):
+    """Peak RSS in KiB and the I/O counters of pid, while it still exists."""
+    stats = {"peak_rss_kib": None, "read_bytes": None, "write_bytes": None}
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    stats["peak_rss_kib"] = int(line.split()[1])
+        with open("/proc/%d/io" % pid) as f:
+            for line in f:
+                key, value = line.split(":")
+                if key == "rchar":
+                    stats["read_bytes"] = int(value)
+                elif key == "wchar":
+                    stats["write_bytes"] = int(value)
+    except (OSError, ValueError):
+        pass
+    return stats
+
+
+def count_lines(path):
+    try:
+        with open(path) as f:
+            return sum(1 for _ in f)
+    except OSError:
+        return 0
+
+
+def find_program_pid(root_pid, binary):
+    """The benchmarked process, which may run below strace."""
+    name = os.path.basename(binary)[:15]
+    pending = [root_pid]
+    while pending:
+        pid = pending.pop()
+        try:
+            with open("/proc/%d/comm" % pid) as f:
+                if f.read().strip() == name:
+                    return pid
+            with open("/proc/%d/task/%d/children" % (pid, pid)) as f:
+                pending.extend(int(c) for c in f.read().split())
+        except OSError:
+            pass
+    return root_pid
+
+
+def run_once(args, n_apps):
+    tmp = tempfile.mkdtemp(prefix="gooroom-bench-")
+    procs = []
+    try:
+        home = os.path.join(tmp, "home")
+        runtime = os.path.join(tmp, "run")
+        counters = os.path.join(tmp, "counters")
+        for d in (home, counters):
+            os.makedirs(d)
+        os.makedirs(runtime, mode=0o700)
+
+        assets = os.path.join(tmp, "assets")
+        write_assets(assets, n_apps)
+        server = start_asset_server(assets)
+        base_url = "http://127.0.0.1:%d" % server.server_address[1]
+
+        user = os.environ.get("USER") or os.getlogin()
+        grm_user = os.path.join(runtime, "gooroom", ".grm-user")
+        write_grm_user(grm_user, user, base_url, n_apps)
+        write_stubs(os.path.join(tmp, "bin"), counters)
+
+        env = dict(os.environ)
+        session_bus, env["DBUS_SESSION_BUS_ADDRESS"] = start_bus(tmp, "session")
+        system_bus, env["DBUS_SYSTEM_BUS_ADDRESS"] = start_bus(tmp, "system")
+        procs += [session_bus, system_bus]
+
+        env.update({
+            "HOME": home,
+            "XDG_RUNTIME_DIR": runtime,
+            "XDG_CONFIG_HOME": os.path.join(home, ".config"),
+            "XDG_CACHE_HOME": os.path.join(home, ".cache"),
+            "XDG_DATA_HOME": os.path.join(home, ".local", "share"),
+            "GSETTINGS_BACKEND": "memory",
+            "PATH": os.path.join(tmp, "bin") + os.pathsep + env.get("PATH", ""),
+        })
+
+        fakes = subprocess.Popen([sys.executable, os.path.join(HERE, "fake_services.py"),
+                                  str(args.monitors)],
+                                 env=env, stdout=subprocess.PIPE, universal_newlines=True)
+        procs.append(fakes)
+        if fakes.stdout.readline().strip() != "ready":
+            raise RuntimeError("fake services did not start")
+
+        nss_wrapper = next((p for p in NSS_WRAPPER_PATHS if os.path.exists(p)), None)
+        if nss_wrapper:
+            passwd = os.path.join(tmp, "passwd")
+            with open(passwd, "w") as f:
+                f.write("%s:x:%d:%d:Bench,,,,gooroom-online-account:%s:/bin/sh\n"
+                        % (user, os.getuid(), os.getgid(), home))
+            env["LD_PRELOAD"] = nss_wrapper
+            env["NSS_WRAPPER_PASSWD"] = passwd
+            env["NSS_WRAPPER_GROUP"] = "/etc/group"
+
+        cmd = [os.path.abspath(args.binary), "--config", grm_user]
+        trace = os.path.join(tmp, "strace.out")
+        if args.strace and shutil.which("strace"):
+            cmd = ["strace", "-f", "-qq", "-e", "trace=fork,vfork,clone,clone3",
+                   "-o", trace] + cmd
+
+        timing_file = os.path.join(runtime, "gooroom", "autostart-timing.json")
+        begin = time.monotonic()
+        program = subprocess.Popen(cmd, env=env, stdout=subprocess.DEVNULL,
+                                   stderr=subprocess.DEVNULL if not args.verbose else None)
+        procs.append(program)
+
+        wall = None
+        stats = {}
+        while time.monotonic() - begin < args.timeout:
+            if os.path.exists(timing_file):
+                wall = time.monotonic() - begin
+                break
+            if program.poll() is not None:
+                break
+            time.sleep(0.01)
+
+        stats = read_proc(find_program_pid(program.pid, args.binary))
+
+        timing = None
+        if wall is not None:
+            with open(timing_file) as f:
+                timing = json.load(f)
+
+        forks = None
+        if os.path.exists(trace):
+            program.send_signal(signal.SIGTERM)
+            program.wait()
+            forks = sum(1 for line in open(trace)
+                        if any(c in line for c in ("fork(", "clone(", "clone3(")) and
+                        "= -1" not in line)
+
+        return {
+            "apps": n_apps,
+            "wall_ms": None if wall is None else round(wall * 1000.0, 1),
+            "total_ms": timing["total_ms"] if timing else None,
+            "phases": timing["phases"] if timing else [],
+            "forks": forks,
+            "panel_restarts": count_lines(os.path.join(counters, "xfce4-panel")),
+            **stats,
+        }
+    finally:
+        for proc in reversed(procs):
+            if proc.poll() is None:
+                proc.terminate()
+                try:
+                    proc.wait(5)
+                except subprocess.TimeoutExpired:
+                    proc.kill()
+        if not args.keep:
+            shutil.rmtree(tmp, ignore_errors=True)
+        else:
+            print("kept %s" % tmp, file=sys.stderr)
+
+
+def summarize_phases(phases):
+    """Duration per phase name; repeated phases (downloads) are summed."""
+    totals = {}
+    for phase in phases:
+        if phase.get("duration_ms") is None:
+            continue
+        name = phase["name"]
+        count, total, longest = totals.get(name, (0, 0.0, 0.0))
+        totals[name] = (count + 1, total + phase["duration_ms"],
+                        max(longest, phase["duration_ms"]))
+    return totals
+
+
+def print_report(results):
+    for result in results:
+        print("N=%-4d wall %s ms, total %s ms, forks %s, panel restarts %d, "
+              "read %s B, written %s B, peak RSS %s KiB"
+              % (result["apps"], result["wall_ms"], result["total_ms"], result["forks"],
+                 result["panel_restarts"], result["read_bytes"], result["write_bytes"],
+                 result["peak_rss_kib"]))
+        for name, (count, total, longest) in sorted(summarize_phases(result["phases"]).items()):
+            print("    %-28s %4dx  %9.1f ms  (max %.1f ms)" % (name, count, total, longest))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--binary", default=os.path.join(HERE, "..", "src",
+                                                         "gooroom-autostart-program"))
+    parser.add_argument("-n", "--apps", type=int, action="append",
+                        help="number of apps in .grm-user (default: 1, 50, 500)")
+    parser.add_argument("--runs", type=int, default=1, help="runs per N")
+    parser.add_argument("--monitors", type=int, default=1,
+                        help="monitors listed under /backdrop in the fake xfconf")
+    parser.add_argument("--timeout", type=float, default=120.0,
+                        help="seconds to wait for the timing record")
+    parser.add_argument("--no-strace", dest="strace", action="store_false",
+                        help="do not count forks with strace")
+    parser.add_argument("--json", help="also write the results to this file")
+    parser.add_argument("--keep", action="store_true", help="keep the scratch directories")
+    parser.add_argument("--verbose", action="store_true", help="show the program's stderr")
+    args = parser.parse_args()
+
+    if not os.environ.get("DISPLAY") and shutil.which("xvfb-run"):
+        os.execvp("xvfb-run", ["xvfb-run", "-a", sys.executable] + sys.argv)
+
+    results = []
+    for n_apps in args.apps or [1, 50, 500]:
+        for _ in range(args.runs):
+            results.append(run_once(args, n_apps))
+
+    print_report(results)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+    return 0 if all(r["wall_ms"] is not None for r in results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,284 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "agent_client.h"
+
+#define	AGENT_BUS_NAME		"kr.gooroom.agent"
+#define	AGENT_OBJECT_PATH	"/kr/gooroom/agent"
+#define	AGENT_INTERFACE		"kr.gooroom.agent"
+
+#define	AGENT_TASK_JSON		"{\"module\":{\"module_name\":\"%s\",\"task\":{\"task_name\":\"%s\",\"in\":{\"login_id\":\"%s\"}}}}"
+
+
+/*
+ * The agent proxy is created in the background; callers waiting for
+ * it are queued in order and run once it is there (or has failed).
+ */
+struct _AgentClient {
+	GDBusProxy *proxy;
+	gboolean    connecting;
+	GList      *waiters;
+};
+
+typedef struct {
+	AgentReadyFunc func;
+	gpointer       user_data;
+} AgentWaiter;
+
+/*
+ * do_task takes a single task, so a batch sends all of its tasks at
+ * once and calls back a single time, after the last reply.
+ */
+struct _AgentBatch {
+	AgentClient    *client;
+	GPtrArray      *requests;
+	gchar         **replies;
+	guint           outstanding;
+	AgentBatchFunc  func;
+	gpointer        user_data;
+};
+
+typedef struct {
+	AgentBatch *batch;
+	guint       index;
+} AgentBatchEntry;
+
+
+static AgentClient *default_client = NULL;
+
+
+
+
+static void
+agent_client_proxy_ready_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	AgentClient *client = (AgentClient *)data;
+	GError *error = NULL;
+	GList *waiters, *l;
+
+	client->proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	client->connecting = FALSE;
+
+	if (!client->proxy) {
+		g_warning ("Could not connect to %s: %s", AGENT_BUS_NAME, error->message);
+		g_error_free (error);
+	}
+
+	waiters = client->waiters;
+	client->waiters = NULL;
+
+	for (l = waiters; l; l = l->next) {
+		AgentWaiter *waiter = (AgentWaiter *)l->data;
+		waiter->func (client->proxy, waiter->user_data);
+		g_free (waiter);
+	}
+	g_list_free (waiters);
+}
+
+AgentClient *
+agent_client_get_default (void)
+{
+	if (!default_client)
+		default_client = g_new0 (AgentClient, 1);
+
+	return default_client;
+}
+
+void
+agent_client_free (AgentClient *client)
+{
+	if (!client)
+		return;
+
+	if (client == default_client)
+		default_client = NULL;
+
+	g_list_free_full (client->waiters, g_free);
+	g_clear_object (&client->proxy);
+	g_free (client);
+}
+
+void
+agent_client_when_ready (AgentClient *client, AgentReadyFunc func, gpointer user_data)
+{
+	g_return_if_fail (client != NULL && func != NULL);
+
+	AgentWaiter *waiter;
+
+	if (client->proxy) {
+		func (client->proxy, user_data);
+		return;
+	}
+
+	waiter = g_new0 (AgentWaiter, 1);
+	waiter->func = func;
+	waiter->user_data = user_data;
+	client->waiters = g_list_append (client->waiters, waiter);
+
+	/* a failed connection is retried by the next caller */
+	if (!client->connecting) {
+		client->connecting = TRUE;
+		g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                  NULL,
+                                  AGENT_BUS_NAME,
+                                  AGENT_OBJECT_PATH,
+                                  AGENT_INTERFACE,
+                                  NULL,
+                                  agent_client_proxy_ready_cb,
+                                  client);
+	}
+}
+
+static void
+agent_batch_free (AgentBatch *batch)
+{
+	guint i;
+
+	/* failed tasks leave holes, so this is no strv */
+	for (i = 0; i < batch->requests->len; i++)
+		g_free (batch->replies[i]);
+
+	g_free (batch->replies);
+	g_ptr_array_free (batch->requests, TRUE);
+	g_free (batch);
+}
+
+static void
+agent_batch_complete (AgentBatch *batch)
+{
+	if (batch->func)
+		batch->func (batch, batch->user_data);
+
+	agent_batch_free (batch);
+}
+
+static void
+agent_batch_task_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	AgentBatchEntry *entry = (AgentBatchEntry *)data;
+	AgentBatch *batch = entry->batch;
+	GError *error = NULL;
+	GVariant *variant;
+
+	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (variant) {
+		GVariant *v = NULL;
+		g_variant_get (variant, "(v)", &v);
+		if (v) {
+			if (g_variant_is_of_type (v, G_VARIANT_TYPE_STRING))
+				batch->replies[entry->index] = g_variant_dup_string (v, NULL);
+			g_variant_unref (v);
+		}
+		g_variant_unref (variant);
+	} else {
+		g_warning ("do_task failed: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (entry);
+
+	if (--batch->outstanding == 0)
+		agent_batch_complete (batch);
+}
+
+static void
+agent_batch_dispatch (GDBusProxy *proxy, gpointer data)
+{
+	AgentBatch *batch = (AgentBatch *)data;
+	guint i;
+
+	if (!proxy || batch->requests->len == 0) {
+		agent_batch_complete (batch);
+		return;
+	}
+
+	batch->outstanding = batch->requests->len;
+
+	for (i = 0; i < batch->requests->len; i++) {
+		AgentBatchEntry *entry = g_new0 (AgentBatchEntry, 1);
+		entry->batch = batch;
+		entry->index = i;
+
+		g_dbus_proxy_call (proxy,
+                           "do_task",
+                           g_variant_new ("(s)", g_ptr_array_index (batch->requests, i)),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           agent_batch_task_done_cb,
+                           entry);
+	}
+}
+
+AgentBatch *
+agent_batch_new (AgentClient *client)
+{
+	g_return_val_if_fail (client != NULL, NULL);
+
+	AgentBatch *batch;
+
+	batch = g_new0 (AgentBatch, 1);
+	batch->client = client;
+	batch->requests = g_ptr_array_new_with_free_func (g_free);
+
+	return batch;
+}
+
+guint
+agent_batch_add (AgentBatch *batch, const gchar *module_name, const gchar *task_name)
+{
+	g_return_val_if_fail (batch != NULL && batch->replies == NULL, 0);
+
+	g_ptr_array_add (batch->requests,
+                     g_strdup_printf (AGENT_TASK_JSON, module_name, task_name, g_get_user_name ()));
+
+	return batch->requests->len - 1;
+}
+
+/* func is called once with every reply in place; the batch is freed after it */
+void
+agent_batch_run (AgentBatch *batch, AgentBatchFunc func, gpointer user_data)
+{
+	g_return_if_fail (batch != NULL);
+
+	batch->func = func;
+	batch->user_data = user_data;
+	batch->replies = g_new0 (gchar *, batch->requests->len + 1);
+
+	agent_client_when_ready (batch->client, agent_batch_dispatch, batch);
+}
+
+const gchar *
+agent_batch_get_reply (AgentBatch *batch, guint index)
+{
+	g_return_val_if_fail (batch != NULL && batch->replies != NULL, NULL);
+
+	if (index >= batch->requests->len)
+		return NULL;
+
+	return batch->replies[index];
+}
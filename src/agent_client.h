@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __AGENT_CLIENT_H__
+#define	__AGENT_CLIENT_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AgentClient AgentClient;
+typedef struct _AgentBatch  AgentBatch;
+
+typedef void (*AgentReadyFunc) (GDBusProxy *proxy, gpointer user_data);
+typedef void (*AgentBatchFunc) (AgentBatch *batch, gpointer user_data);
+
+AgentClient *agent_client_get_default  (void);
+
+void         agent_client_free         (AgentClient    *client);
+
+void         agent_client_when_ready   (AgentClient    *client,
+                                        AgentReadyFunc  func,
+                                        gpointer        user_data);
+
+AgentBatch  *agent_batch_new           (AgentClient    *client);
+
+guint        agent_batch_add           (AgentBatch     *batch,
+                                        const gchar    *module_name,
+                                        const gchar    *task_name);
+
+void         agent_batch_run           (AgentBatch     *batch,
+                                        AgentBatchFunc  func,
+                                        gpointer        user_data);
+
+const gchar *agent_batch_get_reply     (AgentBatch     *batch,
+                                        guint           index);
+
+G_END_DECLS
+
+#endif
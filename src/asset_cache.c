@@ -0,0 +1,453 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "asset_cache.h"
+
+#define	ASSET_CACHE_INDEX		"index"
+
+
+typedef struct {
+	gchar   *url;
+	gchar   *hash;
+	gchar   *etag;
+	gchar   *last_modified;
+	goffset  size;
+	gint64   last_used;
+} AssetEntry;
+
+struct _AssetCache {
+	gchar      *dir;
+	GHashTable *entries;
+	gboolean    dirty;
+};
+
+
+
+
+static void
+asset_entry_free (AssetEntry *entry)
+{
+	g_free (entry->url);
+	g_free (entry->hash);
+	g_free (entry->etag);
+	g_free (entry->last_modified);
+	g_free (entry);
+}
+
+static gchar *
+asset_cache_get_data_path (AssetCache *cache, AssetEntry *entry)
+{
+	return g_build_filename (cache->dir, entry->hash, NULL);
+}
+
+static AssetEntry *
+asset_cache_get_entry (AssetCache *cache, const gchar *url)
+{
+	AssetEntry *entry;
+	gchar *data_path;
+
+	entry = g_hash_table_lookup (cache->entries, url);
+	if (!entry)
+		return NULL;
+
+	/* forget entries whose data has been removed behind our back */
+	data_path = asset_cache_get_data_path (cache, entry);
+	if (!g_file_test (data_path, G_FILE_TEST_IS_REGULAR)) {
+		g_hash_table_remove (cache->entries, url);
+		cache->dirty = TRUE;
+		entry = NULL;
+	}
+	g_free (data_path);
+
+	return entry;
+}
+
+static void
+asset_cache_load_index (AssetCache *cache)
+{
+	gsize i, n_groups = 0;
+	gchar **groups;
+	gchar *index;
+	GKeyFile *keyfile;
+
+	index = g_build_filename (cache->dir, ASSET_CACHE_INDEX, NULL);
+	keyfile = g_key_file_new ();
+
+	if (!g_key_file_load_from_file (keyfile, index, G_KEY_FILE_NONE, NULL))
+		goto done;
+
+	groups = g_key_file_get_groups (keyfile, &n_groups);
+	for (i = 0; i < n_groups; i++) {
+		AssetEntry *entry;
+		gchar *url, *hash;
+
+		url = g_key_file_get_string (keyfile, groups[i], "Url", NULL);
+		hash = g_key_file_get_string (keyfile, groups[i], "Hash", NULL);
+		if (!url || !hash) {
+			g_free (url);
+			g_free (hash);
+			continue;
+		}
+
+		entry = g_new0 (AssetEntry, 1);
+		entry->url = url;
+		entry->hash = hash;
+		entry->etag = g_key_file_get_string (keyfile, groups[i], "ETag", NULL);
+		entry->last_modified = g_key_file_get_string (keyfile, groups[i], "LastModified", NULL);
+		entry->size = g_key_file_get_int64 (keyfile, groups[i], "Size", NULL);
+		entry->last_used = g_key_file_get_int64 (keyfile, groups[i], "LastUsed", NULL);
+
+		g_hash_table_replace (cache->entries, entry->url, entry);
+	}
+	g_strfreev (groups);
+
+done:
+	g_key_file_free (keyfile);
+	g_free (index);
+}
+
+static gint
+compare_last_used (gconstpointer a, gconstpointer b)
+{
+	const AssetEntry *entry_a = a;
+	const AssetEntry *entry_b = b;
+
+	if (entry_a->last_used < entry_b->last_used)
+		return -1;
+	if (entry_a->last_used > entry_b->last_used)
+		return 1;
+
+	return 0;
+}
+
+static gboolean
+asset_cache_hash_in_use (AssetCache *cache, const gchar *hash)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, cache->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		AssetEntry *entry = value;
+		if (g_str_equal (entry->hash, hash))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+asset_cache_evict (AssetCache *cache)
+{
+	goffset total = 0;
+	GList *entries, *l;
+	GHashTable *counted;
+
+	/* assets with the same content share one data file */
+	counted = g_hash_table_new (g_str_hash, g_str_equal);
+	entries = g_hash_table_get_values (cache->entries);
+	for (l = entries; l; l = l->next) {
+		AssetEntry *entry = l->data;
+		if (!g_hash_table_contains (counted, entry->hash)) {
+			g_hash_table_add (counted, entry->hash);
+			total += entry->size;
+		}
+	}
+	g_hash_table_destroy (counted);
+
+	entries = g_list_sort (entries, compare_last_used);
+
+	for (l = entries; l && total > ASSET_CACHE_MAX_SIZE; l = l->next) {
+		AssetEntry *entry = l->data;
+		gchar *hash = g_strdup (entry->hash);
+		goffset size = entry->size;
+
+		g_hash_table_remove (cache->entries, entry->url);
+
+		if (!asset_cache_hash_in_use (cache, hash)) {
+			gchar *data_path = g_build_filename (cache->dir, hash, NULL);
+			g_remove (data_path);
+			g_free (data_path);
+			total -= size;
+		}
+		g_free (hash);
+
+		cache->dirty = TRUE;
+	}
+
+	g_list_free (entries);
+}
+
+AssetCache *
+asset_cache_new (void)
+{
+	AssetCache *cache;
+
+	cache = g_new0 (AssetCache, 1);
+	cache->dir = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME, "assets", NULL);
+	cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            NULL, (GDestroyNotify) asset_entry_free);
+
+	g_mkdir_with_parents (cache->dir, 0700);
+
+	asset_cache_load_index (cache);
+
+	return cache;
+}
+
+void
+asset_cache_free (AssetCache *cache)
+{
+	if (!cache)
+		return;
+
+	asset_cache_save (cache);
+
+	g_hash_table_destroy (cache->entries);
+	g_free (cache->dir);
+	g_free (cache);
+}
+
+gboolean
+asset_cache_lookup (AssetCache   *cache,
+                    const gchar  *url,
+                    gchar       **etag,
+                    gchar       **last_modified)
+{
+	g_return_val_if_fail (cache != NULL && url != NULL, FALSE);
+
+	AssetEntry *entry = asset_cache_get_entry (cache, url);
+	if (!entry)
+		return FALSE;
+
+	if (etag)
+		*etag = g_strdup (entry->etag);
+	if (last_modified)
+		*last_modified = g_strdup (entry->last_modified);
+
+	return TRUE;
+}
+
+gchar *
+asset_cache_get_tmp_path (AssetCache *cache, const gchar *url)
+{
+	g_return_val_if_fail (cache != NULL && url != NULL, NULL);
+
+	gchar *name, *path;
+
+	name = g_compute_checksum_for_string (G_CHECKSUM_SHA1, url, -1);
+	path = g_strdup_printf ("%s/%s.part", cache->dir, name);
+	g_free (name);
+
+	return path;
+}
+
+gboolean
+asset_cache_store (AssetCache  *cache,
+                   const gchar *url,
+                   const gchar *tmp_path,
+                   const gchar *content_hash,
+                   goffset      size,
+                   const gchar *etag,
+                   const gchar *last_modified)
+{
+	g_return_val_if_fail (cache != NULL, FALSE);
+	g_return_val_if_fail (url != NULL && tmp_path != NULL && content_hash != NULL, FALSE);
+
+	AssetEntry *entry, *old_entry;
+	gchar *data_path, *old_hash;
+
+	data_path = g_build_filename (cache->dir, content_hash, NULL);
+
+	/* the same content is already cached for another url */
+	if (g_file_test (data_path, G_FILE_TEST_IS_REGULAR)) {
+		g_remove (tmp_path);
+	} else if (g_rename (tmp_path, data_path) != 0) {
+		g_remove (tmp_path);
+		g_free (data_path);
+		return FALSE;
+	}
+	g_free (data_path);
+
+	entry = g_new0 (AssetEntry, 1);
+	entry->url = g_strdup (url);
+	entry->hash = g_strdup (content_hash);
+	entry->etag = g_strdup (etag);
+	entry->last_modified = g_strdup (last_modified);
+	entry->size = size;
+	entry->last_used = g_get_real_time () / G_USEC_PER_SEC;
+
+	old_entry = g_hash_table_lookup (cache->entries, url);
+	old_hash = old_entry ? g_strdup (old_entry->hash) : NULL;
+
+	g_hash_table_replace (cache->entries, entry->url, entry);
+	cache->dirty = TRUE;
+
+	/* drop the previous content of this url unless another one shares it */
+	if (old_hash && !asset_cache_hash_in_use (cache, old_hash)) {
+		data_path = g_build_filename (cache->dir, old_hash, NULL);
+		g_remove (data_path);
+		g_free (data_path);
+	}
+	g_free (old_hash);
+
+	return TRUE;
+}
+
+void
+asset_cache_remove (AssetCache *cache, const gchar *url)
+{
+	g_return_if_fail (cache != NULL && url != NULL);
+
+	gchar *hash;
+	AssetEntry *entry;
+
+	entry = g_hash_table_lookup (cache->entries, url);
+	if (!entry)
+		return;
+
+	hash = g_strdup (entry->hash);
+
+	g_hash_table_remove (cache->entries, url);
+	cache->dirty = TRUE;
+
+	if (!asset_cache_hash_in_use (cache, hash)) {
+		gchar *data_path = g_build_filename (cache->dir, hash, NULL);
+		g_remove (data_path);
+		g_free (data_path);
+	}
+	g_free (hash);
+}
+
+void
+asset_cache_touch (AssetCache *cache, const gchar *url)
+{
+	g_return_if_fail (cache != NULL && url != NULL);
+
+	AssetEntry *entry = g_hash_table_lookup (cache->entries, url);
+	if (entry) {
+		entry->last_used = g_get_real_time () / G_USEC_PER_SEC;
+		cache->dirty = TRUE;
+	}
+}
+
+gboolean
+asset_cache_materialize (AssetCache  *cache,
+                         const gchar *url,
+                         const gchar *dest_path)
+{
+	g_return_val_if_fail (cache != NULL && url != NULL && dest_path != NULL, FALSE);
+
+	gboolean ret = FALSE;
+	struct stat data_st, dest_st;
+	gchar *data_path, *tmp_path;
+	AssetEntry *entry;
+
+	entry = asset_cache_get_entry (cache, url);
+	if (!entry)
+		return FALSE;
+
+	data_path = asset_cache_get_data_path (cache, entry);
+
+	/* already linked to the cached data, nothing to do */
+	if (g_stat (data_path, &data_st) == 0 &&
+        g_stat (dest_path, &dest_st) == 0 &&
+        data_st.st_dev == dest_st.st_dev && data_st.st_ino == dest_st.st_ino) {
+		ret = TRUE;
+		goto done;
+	}
+
+	/* replace the destination atomically, prefer a hard link over a copy */
+	tmp_path = g_strdup_printf ("%s.tmp", dest_path);
+	g_remove (tmp_path);
+
+	if (link (data_path, tmp_path) != 0) {
+		GFile *src = g_file_new_for_path (data_path);
+		GFile *dest = g_file_new_for_path (tmp_path);
+
+		g_file_copy (src, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, NULL);
+
+		g_object_unref (src);
+		g_object_unref (dest);
+	}
+
+	if (g_rename (tmp_path, dest_path) == 0) {
+		ret = TRUE;
+	} else {
+		g_remove (tmp_path);
+	}
+	g_free (tmp_path);
+
+done:
+	g_free (data_path);
+
+	return ret;
+}
+
+void
+asset_cache_save (AssetCache *cache)
+{
+	g_return_if_fail (cache != NULL);
+
+	gchar *index;
+	GKeyFile *keyfile;
+	GHashTableIter iter;
+	gpointer value;
+
+	asset_cache_evict (cache);
+
+	if (!cache->dirty)
+		return;
+
+	keyfile = g_key_file_new ();
+
+	g_hash_table_iter_init (&iter, cache->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		AssetEntry *entry = value;
+		gchar *group = g_compute_checksum_for_string (G_CHECKSUM_SHA1, entry->url, -1);
+
+		g_key_file_set_string (keyfile, group, "Url", entry->url);
+		g_key_file_set_string (keyfile, group, "Hash", entry->hash);
+		if (entry->etag)
+			g_key_file_set_string (keyfile, group, "ETag", entry->etag);
+		if (entry->last_modified)
+			g_key_file_set_string (keyfile, group, "LastModified", entry->last_modified);
+		g_key_file_set_int64 (keyfile, group, "Size", entry->size);
+		g_key_file_set_int64 (keyfile, group, "LastUsed", entry->last_used);
+
+		g_free (group);
+	}
+
+	index = g_build_filename (cache->dir, ASSET_CACHE_INDEX, NULL);
+	if (g_key_file_save_to_file (keyfile, index, NULL))
+		cache->dirty = FALSE;
+	g_free (index);
+
+	g_key_file_free (keyfile);
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __ASSET_CACHE_H__
+#define	__ASSET_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* upper bound of the cached data, least recently used assets go first */
+#define	ASSET_CACHE_MAX_SIZE	(64 * 1024 * 1024)
+
+typedef struct _AssetCache AssetCache;
+
+AssetCache *asset_cache_new          (void);
+
+void        asset_cache_free         (AssetCache   *cache);
+
+gboolean    asset_cache_lookup       (AssetCache   *cache,
+                                      const gchar  *url,
+                                      gchar       **etag,
+                                      gchar       **last_modified);
+
+gchar      *asset_cache_get_tmp_path (AssetCache   *cache,
+                                      const gchar  *url);
+
+gboolean    asset_cache_store        (AssetCache   *cache,
+                                      const gchar  *url,
+                                      const gchar  *tmp_path,
+                                      const gchar  *content_hash,
+                                      goffset       size,
+                                      const gchar  *etag,
+                                      const gchar  *last_modified);
+
+void        asset_cache_remove       (AssetCache   *cache,
+                                      const gchar  *url);
+
+void        asset_cache_touch        (AssetCache   *cache,
+                                      const gchar  *url);
+
+gboolean    asset_cache_materialize  (AssetCache   *cache,
+                                      const gchar  *url,
+                                      const gchar  *dest_path);
+
+void        asset_cache_save         (AssetCache   *cache);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,812 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include "downloader.h"
+#include "login_timing.h"
+#include "metrics.h"
+
+#define	DOWNLOAD_MAX_HOST_CONNECTIONS	6
+#define	DOWNLOAD_CONNECT_TIMEOUT		10
+#define	DOWNLOAD_LOW_SPEED_TIME			30
+#define	DOWNLOAD_WAIT_TIMEOUT_MS		1000
+
+/* next to a partial file, holds the validator of the entity it belongs to */
+#define	DOWNLOAD_RESUME_SUFFIX			".resume"
+
+
+typedef struct {
+	gchar              *url;
+	gchar              *path;
+	gchar              *tmp_path;
+	FILE               *fp;
+	CURL               *easy;
+	struct curl_slist  *headers;
+	GChecksum          *checksum;
+	goffset             size;
+	goffset             received;
+	goffset             resume_from;
+	goffset             range_start;
+	gboolean            range_checked;
+	gboolean            range_mismatch;
+	gboolean            interrupted;
+	gchar              *etag;
+	gchar              *last_modified;
+	guint               timing_id;
+	gint64              begin;
+	gboolean            started;
+	gboolean            done;
+	gboolean            success;
+} DownloadJob;
+
+struct _Downloader {
+	CURLM              *multi;
+	CURLSH             *share;
+	GPtrArray          *jobs;
+	AssetCache         *cache;
+	gchar              *asset_dir;
+
+	/* downloader_run_async (): curl's sockets and timer as GSources */
+	GHashTable         *watches;
+	guint               timer_id;
+	guint               done_id;
+	DownloaderDoneFunc  done_func;
+	gpointer            done_data;
+};
+
+
+
+
+static void
+download_job_free (DownloadJob *job)
+{
+	if (job->fp)
+		fclose (job->fp);
+
+	if (job->easy)
+		curl_easy_cleanup (job->easy);
+
+	if (job->headers)
+		curl_slist_free_all (job->headers);
+
+	if (job->checksum)
+		g_checksum_free (job->checksum);
+
+	g_free (job->url);
+	g_free (job->path);
+	g_free (job->tmp_path);
+	g_free (job->etag);
+	g_free (job->last_modified);
+	g_free (job);
+}
+
+static size_t
+download_job_write_cb (char *ptr, size_t size, size_t nmemb, void *data)
+{
+	DownloadJob *job = (DownloadJob *)data;
+	size_t len = size * nmemb;
+
+	if (job->resume_from > 0 && !job->range_checked) {
+		long response_code = 0;
+
+		job->range_checked = TRUE;
+		curl_easy_getinfo (job->easy, CURLINFO_RESPONSE_CODE, &response_code);
+
+		/* a 206 for other bytes than asked for cannot be appended */
+		if (response_code == 206 && job->range_start != job->resume_from) {
+			g_warning ("%s: range starts at %" G_GOFFSET_FORMAT " instead of %" G_GOFFSET_FORMAT,
+                       job->url, job->range_start, job->resume_from);
+			job->range_mismatch = TRUE;
+			return 0;
+		}
+
+		/* the entity has changed, so If-Range got us all of it */
+		if (response_code != 206) {
+			if (fflush (job->fp) != 0 || ftruncate (fileno (job->fp), 0) != 0)
+				return 0;
+			job->size = 0;
+			job->resume_from = 0;
+			if (job->checksum)
+				g_checksum_reset (job->checksum);
+		}
+	}
+
+	if (fwrite (ptr, 1, len, job->fp) != len)
+		return 0;
+
+	if (job->checksum)
+		g_checksum_update (job->checksum, (const guchar *)ptr, len);
+
+	job->size += len;
+	job->received += len;
+
+	return len;
+}
+
+static void
+replace_header_value (gchar **value, const gchar *line, gsize prefix_len)
+{
+	g_free (*value);
+	*value = g_strstrip (g_strdup (line + prefix_len));
+}
+
+static size_t
+download_job_header_cb (char *buffer, size_t size, size_t nitems, void *data)
+{
+	DownloadJob *job = (DownloadJob *)data;
+	size_t len = size * nitems;
+	gchar *line = g_strndup (buffer, len);
+
+	if (g_str_has_prefix (line, "HTTP/")) {
+		/* headers of a previous response (e.g. a redirect) do not count */
+		g_clear_pointer (&job->etag, g_free);
+		g_clear_pointer (&job->last_modified, g_free);
+		job->range_start = -1;
+	} else if (g_ascii_strncasecmp (line, "Content-Range:", 14) == 0) {
+		/* bytes <first>-<last>/<length> */
+		const gchar *value = line + 14;
+		gchar *end = NULL;
+
+		while (g_ascii_isspace (*value))
+			value++;
+		if (g_ascii_strncasecmp (value, "bytes", 5) == 0 && g_ascii_isspace (value[5])) {
+			gint64 start = g_ascii_strtoll (value + 6, &end, 10);
+			if (end != value + 6 && *end == '-')
+				job->range_start = start;
+		}
+	} else if (g_ascii_strncasecmp (line, "ETag:", 5) == 0) {
+		replace_header_value (&job->etag, line, 5);
+	} else if (g_ascii_strncasecmp (line, "Last-Modified:", 14) == 0) {
+		replace_header_value (&job->last_modified, line, 14);
+	}
+
+	g_free (line);
+
+	return len;
+}
+
+static DownloadJob *
+downloader_find_job (Downloader *downloader, const gchar *url, const gchar *path)
+{
+	guint i;
+
+	for (i = 0; i < downloader->jobs->len; i++) {
+		DownloadJob *job = g_ptr_array_index (downloader->jobs, i);
+		if (g_str_equal (job->path, path) && g_str_equal (job->url, url))
+			return job;
+	}
+
+	return NULL;
+}
+
+static gchar *
+download_job_get_resume_path (DownloadJob *job)
+{
+	return g_strconcat (job->tmp_path, DOWNLOAD_RESUME_SUFFIX, NULL);
+}
+
+static gboolean
+checksum_update_from_file (GChecksum *checksum, const gchar *path)
+{
+	FILE *fp;
+	gsize len;
+	guchar buffer[8192];
+
+	fp = g_fopen (path, "rb");
+	if (!fp)
+		return FALSE;
+
+	while ((len = fread (buffer, 1, sizeof (buffer), fp)) > 0)
+		g_checksum_update (checksum, buffer, len);
+
+	return (fclose (fp) == 0);
+}
+
+/* picks up the partial file of an interrupted transfer, if it is still usable */
+static void
+download_job_prepare_resume (DownloadJob *job)
+{
+	GStatBuf st;
+	gchar *resume_path, *validator = NULL;
+
+	resume_path = download_job_get_resume_path (job);
+
+	if (g_stat (job->tmp_path, &st) == 0 && st.st_size > 0 &&
+        g_file_get_contents (resume_path, &validator, NULL, NULL) &&
+        *g_strstrip (validator) != '\0' &&
+        (!job->checksum || checksum_update_from_file (job->checksum, job->tmp_path))) {
+		gchar *header;
+
+		job->resume_from = st.st_size;
+		job->size = st.st_size;
+
+		header = g_strdup_printf ("Range: bytes=%" G_GOFFSET_FORMAT "-", job->resume_from);
+		job->headers = curl_slist_append (job->headers, header);
+		g_free (header);
+
+		header = g_strdup_printf ("If-Range: %s", validator);
+		job->headers = curl_slist_append (job->headers, header);
+		g_free (header);
+	} else {
+		if (job->checksum)
+			g_checksum_reset (job->checksum);
+		g_remove (job->tmp_path);
+		g_remove (resume_path);
+	}
+
+	g_free (validator);
+	g_free (resume_path);
+}
+
+/* keeps the partial file of an interrupted transfer for the next attempt */
+static void
+download_job_keep_partial (DownloadJob *job)
+{
+	gchar *resume_path;
+	gboolean kept = FALSE;
+	const gchar *validator = NULL;
+
+	resume_path = download_job_get_resume_path (job);
+
+	/* weak ETags cannot be used with If-Range */
+	if (job->etag && !g_str_has_prefix (job->etag, "W/"))
+		validator = job->etag;
+	else if (job->last_modified)
+		validator = job->last_modified;
+
+	/* nothing is kept when it did not line up with the range the server sent */
+	if (job->interrupted && !job->range_mismatch && job->size > 0) {
+		if (validator) {
+			kept = g_file_set_contents (resume_path, validator, -1, NULL);
+		} else {
+			/* nothing new arrived, the earlier validator still holds */
+			kept = (job->resume_from > 0 && g_file_test (resume_path, G_FILE_TEST_EXISTS));
+		}
+	}
+
+	if (!kept) {
+		g_remove (job->tmp_path);
+		g_remove (resume_path);
+	}
+
+	g_free (resume_path);
+}
+
+/* file:// URL of the file in asset_dir named like the last path segment of url */
+static gchar *
+downloader_get_local_url (Downloader *downloader, const gchar *url)
+{
+	gchar *name, *path, *local_url;
+	const gchar *end, *begin;
+
+	end = url + strcspn (url, "?#");
+	for (begin = end; begin > url && *(begin - 1) != '/'; begin--);
+
+	name = g_uri_unescape_segment (begin, end, "/");
+	path = g_build_filename (downloader->asset_dir, name ? name : "", NULL);
+	local_url = g_filename_to_uri (path, NULL, NULL);
+	g_free (path);
+	g_free (name);
+
+	return local_url ? local_url : g_strdup (url);
+}
+
+static gboolean
+download_job_start (Downloader *downloader, DownloadJob *job)
+{
+	job->started = TRUE;
+	job->begin = g_get_monotonic_time ();
+	job->timing_id = login_timing_begin ("download", job->url);
+
+	if (downloader->cache) {
+		job->tmp_path = asset_cache_get_tmp_path (downloader->cache, job->url);
+		job->checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	} else {
+		/* the destination is only replaced once the new file is complete */
+		job->tmp_path = g_strdup_printf ("%s.part", job->path);
+	}
+
+	download_job_prepare_resume (job);
+
+	if (downloader->cache && job->resume_from == 0) {
+		gchar *etag = NULL, *last_modified = NULL;
+
+		/* revalidate what we already have instead of fetching it again */
+		if (asset_cache_lookup (downloader->cache, job->url, &etag, &last_modified)) {
+			gchar *header;
+			if (etag) {
+				header = g_strdup_printf ("If-None-Match: %s", etag);
+				job->headers = curl_slist_append (job->headers, header);
+				g_free (header);
+			}
+			if (last_modified) {
+				header = g_strdup_printf ("If-Modified-Since: %s", last_modified);
+				job->headers = curl_slist_append (job->headers, header);
+				g_free (header);
+			}
+		}
+		g_free (etag);
+		g_free (last_modified);
+	}
+
+	/* in append mode, a truncate in download_job_write_cb () starts the file over */
+	job->fp = g_fopen (job->tmp_path, job->resume_from > 0 ? "ab" : "wb");
+	if (!job->fp)
+		return FALSE;
+
+	job->easy = curl_easy_init ();
+	if (!job->easy)
+		return FALSE;
+
+	if (downloader->asset_dir) {
+		gchar *local_url = downloader_get_local_url (downloader, job->url);
+		curl_easy_setopt (job->easy, CURLOPT_URL, local_url);
+		g_free (local_url);
+	} else {
+		curl_easy_setopt (job->easy, CURLOPT_URL, job->url);
+	}
+	curl_easy_setopt (job->easy, CURLOPT_WRITEFUNCTION, download_job_write_cb);
+	curl_easy_setopt (job->easy, CURLOPT_WRITEDATA, job);
+	curl_easy_setopt (job->easy, CURLOPT_HEADERFUNCTION, download_job_header_cb);
+	curl_easy_setopt (job->easy, CURLOPT_HEADERDATA, job);
+	if (job->headers)
+		curl_easy_setopt (job->easy, CURLOPT_HTTPHEADER, job->headers);
+	curl_easy_setopt (job->easy, CURLOPT_PRIVATE, job);
+	curl_easy_setopt (job->easy, CURLOPT_SHARE, downloader->share);
+	curl_easy_setopt (job->easy, CURLOPT_USERAGENT, PACKAGE_NAME "/" PACKAGE_VERSION);
+	curl_easy_setopt (job->easy, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt (job->easy, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt (job->easy, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt (job->easy, CURLOPT_CONNECTTIMEOUT, (long)DOWNLOAD_CONNECT_TIMEOUT);
+	/* abort stalled transfers instead of blocking the login */
+	curl_easy_setopt (job->easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt (job->easy, CURLOPT_LOW_SPEED_TIME, (long)DOWNLOAD_LOW_SPEED_TIME);
+	/* same as 'wget --no-check-certificate' which has been used so far */
+	curl_easy_setopt (job->easy, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt (job->easy, CURLOPT_SSL_VERIFYHOST, 0L);
+#ifdef CURLPIPE_MULTIPLEX
+	curl_easy_setopt (job->easy, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+	if (curl_multi_add_handle (downloader->multi, job->easy) != CURLM_OK)
+		return FALSE;
+
+	return TRUE;
+}
+
+static gboolean
+download_job_publish (Downloader *downloader, DownloadJob *job, long response_code)
+{
+	AssetCache *cache = downloader->cache;
+
+	if (response_code == 304) {
+		/* not modified: skip the transfer and reuse the cached copy */
+		g_remove (job->tmp_path);
+		asset_cache_touch (cache, job->url);
+		metrics_count ("asset_cache.hits", 1);
+	} else if (job->size > ASSET_CACHE_MAX_SIZE) {
+		gboolean ret;
+		GFile *src, *dest;
+
+		/* caching it would evict everything else and then itself */
+		asset_cache_remove (cache, job->url);
+
+		src = g_file_new_for_path (job->tmp_path);
+		dest = g_file_new_for_path (job->path);
+		ret = g_file_move (src, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, NULL);
+		g_object_unref (src);
+		g_object_unref (dest);
+
+		return ret;
+	} else {
+		if (!asset_cache_store (cache, job->url, job->tmp_path,
+                                g_checksum_get_string (job->checksum), job->size,
+                                job->etag, job->last_modified))
+			return FALSE;
+	}
+
+	return asset_cache_materialize (cache, job->url, job->path);
+}
+
+static void
+download_job_finish (Downloader *downloader, DownloadJob *job, gboolean success)
+{
+	long response_code = 0;
+
+	if (job->easy) {
+		curl_easy_getinfo (job->easy, CURLINFO_RESPONSE_CODE, &response_code);
+		curl_multi_remove_handle (downloader->multi, job->easy);
+		curl_easy_cleanup (job->easy);
+		job->easy = NULL;
+	}
+
+	if (job->fp) {
+		if (fclose (job->fp) != 0)
+			success = FALSE;
+		job->fp = NULL;
+	}
+
+	if (success) {
+		gchar *resume_path = download_job_get_resume_path (job);
+		g_remove (resume_path);
+		g_free (resume_path);
+
+		if (downloader->cache) {
+			success = download_job_publish (downloader, job, response_code);
+		} else {
+			success = (g_rename (job->tmp_path, job->path) == 0);
+		}
+	}
+
+	if (!success && job->tmp_path)
+		download_job_keep_partial (job);
+
+	job->done = TRUE;
+	job->success = success;
+
+	login_timing_end (job->timing_id, success);
+
+	metrics_count (success ? "downloads" : "downloads.failed", 1);
+	metrics_count ("downloads.bytes", job->received);
+	if (job->begin > 0)
+		metrics_observe ("download", (gdouble)(g_get_monotonic_time () - job->begin) / 1000.0);
+}
+
+static void
+downloader_start_jobs (Downloader *downloader)
+{
+	guint i;
+
+	for (i = 0; i < downloader->jobs->len; i++) {
+		DownloadJob *job = g_ptr_array_index (downloader->jobs, i);
+		if (job->started)
+			continue;
+
+		if (!download_job_start (downloader, job))
+			download_job_finish (downloader, job, FALSE);
+	}
+}
+
+static void
+downloader_read_done (Downloader *downloader)
+{
+	gint left = 0;
+	CURLMsg *msg;
+
+	while ((msg = curl_multi_info_read (downloader->multi, &left)) != NULL) {
+		DownloadJob *job = NULL;
+
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **)&job);
+		if (job) {
+			/* an HTTP error is final; anything else may be resumed later */
+			job->interrupted = (msg->data.result != CURLE_OK &&
+                                msg->data.result != CURLE_HTTP_RETURNED_ERROR);
+			download_job_finish (downloader, job, (msg->data.result == CURLE_OK));
+		}
+	}
+}
+
+/* anything left over was aborted by a multi interface error */
+static void
+downloader_finish_leftovers (Downloader *downloader)
+{
+	guint i;
+
+	for (i = 0; i < downloader->jobs->len; i++) {
+		DownloadJob *job = g_ptr_array_index (downloader->jobs, i);
+		if (job->started && !job->done)
+			download_job_finish (downloader, job, FALSE);
+	}
+}
+
+static gboolean
+downloader_watch_remove (gpointer key, gpointer value, gpointer data)
+{
+	g_source_remove (GPOINTER_TO_UINT (value));
+
+	return TRUE;
+}
+
+/* back to curl_multi_perform (): no more callbacks into the main loop */
+static void
+downloader_unwatch (Downloader *downloader)
+{
+	g_hash_table_foreach_remove (downloader->watches, downloader_watch_remove, NULL);
+
+	if (downloader->timer_id) {
+		g_source_remove (downloader->timer_id);
+		downloader->timer_id = 0;
+	}
+
+	curl_multi_setopt (downloader->multi, CURLMOPT_SOCKETFUNCTION, NULL);
+	curl_multi_setopt (downloader->multi, CURLMOPT_TIMERFUNCTION, NULL);
+}
+
+static gboolean
+downloader_done_cb (gpointer data)
+{
+	Downloader *downloader = (Downloader *)data;
+	DownloaderDoneFunc func = downloader->done_func;
+
+	downloader->done_id = 0;
+	downloader->done_func = NULL;
+
+	func (downloader, downloader->done_data);
+
+	return FALSE;
+}
+
+static void
+downloader_socket_action (Downloader *downloader, curl_socket_t fd, gint events)
+{
+	gint running = 0;
+
+	curl_multi_socket_action (downloader->multi, fd, events, &running);
+
+	downloader_read_done (downloader);
+
+	if (running == 0 && downloader->done_func && !downloader->done_id) {
+		downloader_finish_leftovers (downloader);
+		/* not from within curl's or a watch's callback: func may free us */
+		downloader->done_id = g_idle_add (downloader_done_cb, downloader);
+	}
+}
+
+static gboolean
+downloader_fd_cb (gint fd, GIOCondition condition, gpointer data)
+{
+	gint events = 0;
+
+	if (condition & G_IO_IN)
+		events |= CURL_CSELECT_IN;
+	if (condition & G_IO_OUT)
+		events |= CURL_CSELECT_OUT;
+	if (condition & (G_IO_ERR | G_IO_HUP))
+		events |= CURL_CSELECT_ERR;
+
+	downloader_socket_action ((Downloader *)data, fd, events);
+
+	/* curl removes the watch through downloader_socket_cb () */
+	return G_SOURCE_CONTINUE;
+}
+
+static int
+downloader_socket_cb (CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+	Downloader *downloader = (Downloader *)userp;
+	gpointer watch_id;
+	GIOCondition condition = 0;
+
+	if (g_hash_table_lookup_extended (downloader->watches, GINT_TO_POINTER (fd), NULL, &watch_id)) {
+		g_source_remove (GPOINTER_TO_UINT (watch_id));
+		g_hash_table_remove (downloader->watches, GINT_TO_POINTER (fd));
+	}
+
+	if (what == CURL_POLL_REMOVE)
+		return 0;
+
+	if (what & CURL_POLL_IN)
+		condition |= G_IO_IN;
+	if (what & CURL_POLL_OUT)
+		condition |= G_IO_OUT;
+
+	g_hash_table_insert (downloader->watches, GINT_TO_POINTER (fd),
+                         GUINT_TO_POINTER (g_unix_fd_add (fd, condition | G_IO_ERR | G_IO_HUP,
+                                                          downloader_fd_cb, downloader)));
+
+	return 0;
+}
+
+static gboolean
+downloader_timeout_cb (gpointer data)
+{
+	Downloader *downloader = (Downloader *)data;
+
+	downloader->timer_id = 0;
+	downloader_socket_action (downloader, CURL_SOCKET_TIMEOUT, 0);
+
+	return FALSE;
+}
+
+/* curl must not be called back into from here, hence the GSource */
+static int
+downloader_timer_cb (CURLM *multi, long timeout_ms, void *userp)
+{
+	Downloader *downloader = (Downloader *)userp;
+
+	if (downloader->timer_id) {
+		g_source_remove (downloader->timer_id);
+		downloader->timer_id = 0;
+	}
+
+	if (timeout_ms >= 0)
+		downloader->timer_id = g_timeout_add ((guint) timeout_ms, downloader_timeout_cb, downloader);
+
+	return 0;
+}
+
+Downloader *
+downloader_new (void)
+{
+	static gsize curl_initialized = 0;
+	Downloader *downloader;
+
+	if (g_once_init_enter (&curl_initialized)) {
+		curl_global_init (CURL_GLOBAL_DEFAULT);
+		g_once_init_leave (&curl_initialized, 1);
+	}
+
+	downloader = g_new0 (Downloader, 1);
+	downloader->jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) download_job_free);
+	downloader->watches = g_hash_table_new (NULL, NULL);
+
+	/* all transfers reuse the same connections, DNS entries and TLS sessions */
+	downloader->multi = curl_multi_init ();
+#ifdef CURLPIPE_MULTIPLEX
+	curl_multi_setopt (downloader->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+	curl_multi_setopt (downloader->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)DOWNLOAD_MAX_HOST_CONNECTIONS);
+
+	downloader->share = curl_share_init ();
+	curl_share_setopt (downloader->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt (downloader->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+	return downloader;
+}
+
+void
+downloader_free (Downloader *downloader)
+{
+	if (!downloader)
+		return;
+
+	downloader_unwatch (downloader);
+	if (downloader->done_id)
+		g_source_remove (downloader->done_id);
+
+	/* easy handles must leave the multi handle before it is cleaned up */
+	g_ptr_array_free (downloader->jobs, TRUE);
+	g_hash_table_destroy (downloader->watches);
+
+	curl_multi_cleanup (downloader->multi);
+	curl_share_cleanup (downloader->share);
+
+	g_free (downloader->asset_dir);
+	g_free (downloader);
+}
+
+void
+downloader_set_cache (Downloader *downloader, AssetCache *cache)
+{
+	g_return_if_fail (downloader != NULL);
+
+	downloader->cache = cache;
+}
+
+/* fetches every URL from a local directory instead, keyed by file name;
+ * results are still looked up and cached under the original URLs */
+void
+downloader_set_asset_dir (Downloader *downloader, const gchar *dir)
+{
+	g_return_if_fail (downloader != NULL);
+
+	g_free (downloader->asset_dir);
+	downloader->asset_dir = g_strdup (dir);
+}
+
+void
+downloader_add (Downloader *downloader, const gchar *url, const gchar *path)
+{
+	g_return_if_fail (downloader != NULL);
+	g_return_if_fail (url != NULL && path != NULL);
+
+	DownloadJob *job;
+
+	if (downloader_find_job (downloader, url, path))
+		return;
+
+	job = g_new0 (DownloadJob, 1);
+	job->url = g_strdup (url);
+	job->path = g_strdup (path);
+	job->range_start = -1;
+
+	g_ptr_array_add (downloader->jobs, job);
+}
+
+/* blocks until every transfer added so far has finished */
+void
+downloader_run (Downloader *downloader)
+{
+	g_return_if_fail (downloader != NULL);
+
+	gint running = 0;
+
+	/* curl_multi_perform () and the socket interface do not mix */
+	downloader_unwatch (downloader);
+
+	downloader_start_jobs (downloader);
+
+	do {
+		if (curl_multi_perform (downloader->multi, &running) != CURLM_OK)
+			break;
+
+		downloader_read_done (downloader);
+
+		if (running > 0)
+			curl_multi_wait (downloader->multi, NULL, 0, DOWNLOAD_WAIT_TIMEOUT_MS, NULL);
+	} while (running > 0);
+
+	downloader_finish_leftovers (downloader);
+}
+
+/* runs the transfers from the main loop; func is called from an idle
+ * once all of them have finished, the downloader must outlive that */
+void
+downloader_run_async (Downloader *downloader, DownloaderDoneFunc func, gpointer data)
+{
+	g_return_if_fail (downloader != NULL);
+	g_return_if_fail (downloader->done_func == NULL);
+
+	downloader->done_func = func;
+	downloader->done_data = data;
+
+	curl_multi_setopt (downloader->multi, CURLMOPT_SOCKETFUNCTION, downloader_socket_cb);
+	curl_multi_setopt (downloader->multi, CURLMOPT_SOCKETDATA, downloader);
+	curl_multi_setopt (downloader->multi, CURLMOPT_TIMERFUNCTION, downloader_timer_cb);
+	curl_multi_setopt (downloader->multi, CURLMOPT_TIMERDATA, downloader);
+
+	downloader_start_jobs (downloader);
+
+	downloader_socket_action (downloader, CURL_SOCKET_TIMEOUT, 0);
+}
+
+gboolean
+downloader_lookup (Downloader  *downloader,
+                   const gchar *url,
+                   const gchar *path,
+                   gboolean    *success)
+{
+	g_return_val_if_fail (downloader != NULL, FALSE);
+
+	DownloadJob *job = downloader_find_job (downloader, url, path);
+
+	if (!job || !job->done)
+		return FALSE;
+
+	if (success)
+		*success = job->success;
+
+	return TRUE;
+}
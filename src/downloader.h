@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __DOWNLOADER_H__
+#define	__DOWNLOADER_H__
+
+#include <glib.h>
+
+#include "asset_cache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Downloader Downloader;
+
+typedef void (*DownloaderDoneFunc) (Downloader *downloader, gpointer data);
+
+Downloader *downloader_new           (void);
+
+void        downloader_free          (Downloader  *downloader);
+
+void        downloader_set_cache     (Downloader  *downloader,
+                                      AssetCache  *cache);
+
+void        downloader_set_asset_dir (Downloader  *downloader,
+                                      const gchar *dir);
+
+void        downloader_add           (Downloader  *downloader,
+                                      const gchar *url,
+                                      const gchar *path);
+
+void        downloader_run           (Downloader  *downloader);
+
+void        downloader_run_async     (Downloader         *downloader,
+                                      DownloaderDoneFunc  func,
+                                      gpointer            data);
+
+gboolean    downloader_lookup        (Downloader  *downloader,
+                                      const gchar *url,
+                                      const gchar *path,
+                                      gboolean    *success);
+
+G_END_DECLS
+
+#endif
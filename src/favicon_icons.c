@@ -0,0 +1,309 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "favicon_icons.h"
+#include "replay_trace.h"
+
+#define	ICON_NAME_PREFIX	"gooroom-favicon-"
+
+
+/*
+ * Downloaded favicons are decoded and installed as PNGs at the usual
+ * sizes into the user's hicolor theme, so the dock and the menu load a
+ * small icon by name. Names carry a hash of the decoded image: a new
+ * favicon gets a new name and unchanged ones are left alone. Icons that
+ * were not installed again are removed by favicon_icons_commit (),
+ * which also refreshes the theme's icon cache when anything changed.
+ */
+struct _FaviconIcons {
+	gchar      *theme_dir;
+	GHashTable *installed;
+	gboolean    changed;
+};
+
+typedef struct {
+	FaviconIconsDoneFunc func;
+	gpointer             data;
+} IconCacheUpdate;
+
+static const gint icon_sizes[] = { 16, 24, 32, 48, 64, 128 };
+
+
+
+
+static gchar *
+icon_get_path (FaviconIcons *icons, gint size, const gchar *name)
+{
+	gchar *size_dir, *file, *path;
+
+	size_dir = g_strdup_printf ("%dx%d", size, size);
+	file = g_strdup_printf ("%s.png", name);
+	path = g_build_filename (icons->theme_dir, size_dir, "apps", file, NULL);
+	g_free (file);
+	g_free (size_dir);
+
+	return path;
+}
+
+static gboolean
+icon_write (GdkPixbuf *pixbuf, gint size, const gchar *path)
+{
+	gint width, height;
+	gboolean ret;
+	gchar *dir, *tmp;
+	GdkPixbuf *scaled;
+	GError *error = NULL;
+
+	/* fit into size x size, keeping the aspect ratio */
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+	if (width >= height) {
+		height = MAX (1, height * size / width);
+		width = size;
+	} else {
+		width = MAX (1, width * size / height);
+		height = size;
+	}
+
+	scaled = gdk_pixbuf_scale_simple (pixbuf, width, height,
+                                      width < gdk_pixbuf_get_width (pixbuf) ?
+                                      GDK_INTERP_HYPER : GDK_INTERP_BILINEAR);
+	if (!scaled)
+		return FALSE;
+
+	dir = g_path_get_dirname (path);
+	g_mkdir_with_parents (dir, 0755);
+	g_free (dir);
+
+	tmp = g_strdup_printf ("%s.tmp", path);
+	ret = gdk_pixbuf_save (scaled, tmp, "png", &error, NULL);
+	if (ret) {
+		ret = (g_rename (tmp, path) == 0);
+	} else {
+		g_warning ("Failed to write %s: %s", path, error->message);
+		g_error_free (error);
+	}
+
+	if (!ret)
+		g_remove (tmp);
+
+	g_free (tmp);
+	g_object_unref (scaled);
+
+	return ret;
+}
+
+static gchar *
+icon_get_name (GdkPixbuf *pixbuf)
+{
+	gint y, height, rowstride;
+	gsize row_length;
+	gchar *hash, *name;
+	GChecksum *checksum;
+	const guchar *pixels;
+
+	height = gdk_pixbuf_get_height (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	pixels = gdk_pixbuf_read_pixels (pixbuf);
+
+	/* row padding is left out, it is not initialized */
+	row_length = (gsize) gdk_pixbuf_get_width (pixbuf) * gdk_pixbuf_get_n_channels (pixbuf) *
+                 gdk_pixbuf_get_bits_per_sample (pixbuf) / 8;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	for (y = 0; y < height; y++)
+		g_checksum_update (checksum, pixels + (gsize) y * rowstride, row_length);
+	hash = g_strndup (g_checksum_get_string (checksum), 16);
+	g_checksum_free (checksum);
+
+	name = g_strdup_printf ("%s%s", ICON_NAME_PREFIX, hash);
+	g_free (hash);
+
+	return name;
+}
+
+static void
+icons_prune (FaviconIcons *icons)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (icon_sizes); i++) {
+		GDir *dir;
+		const gchar *file;
+		gchar *size_dir, *apps_dir;
+
+		size_dir = g_strdup_printf ("%dx%d", icon_sizes[i], icon_sizes[i]);
+		apps_dir = g_build_filename (icons->theme_dir, size_dir, "apps", NULL);
+		g_free (size_dir);
+
+		dir = g_dir_open (apps_dir, 0, NULL);
+		if (dir) {
+			while ((file = g_dir_read_name (dir)) != NULL) {
+				gchar *name;
+
+				if (!g_str_has_prefix (file, ICON_NAME_PREFIX) || !g_str_has_suffix (file, ".png"))
+					continue;
+
+				name = g_strndup (file, strlen (file) - strlen (".png"));
+				if (!g_hash_table_contains (icons->installed, name)) {
+					gchar *path = g_build_filename (apps_dir, file, NULL);
+					g_remove (path);
+					g_free (path);
+					icons->changed = TRUE;
+				}
+				g_free (name);
+			}
+			g_dir_close (dir);
+		}
+
+		g_free (apps_dir);
+	}
+}
+
+FaviconIcons *
+favicon_icons_new (void)
+{
+	FaviconIcons *icons;
+
+	icons = g_new0 (FaviconIcons, 1);
+	icons->theme_dir = g_build_filename (g_get_user_data_dir (), "icons", "hicolor", NULL);
+	icons->installed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return icons;
+}
+
+void
+favicon_icons_free (FaviconIcons *icons)
+{
+	if (!icons)
+		return;
+
+	g_hash_table_destroy (icons->installed);
+	g_free (icons->theme_dir);
+	g_free (icons);
+}
+
+/* returns the icon name for file, or NULL when it is not a usable image */
+gchar *
+favicon_icons_install (FaviconIcons *icons, const gchar *file)
+{
+	g_return_val_if_fail (icons != NULL && file != NULL, NULL);
+
+	guint i;
+	gchar *name;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	pixbuf = gdk_pixbuf_new_from_file (file, &error);
+	if (!pixbuf) {
+		g_warning ("Could not decode favicon %s: %s", file, error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	name = icon_get_name (pixbuf);
+
+	for (i = 0; i < G_N_ELEMENTS (icon_sizes); i++) {
+		gchar *path = icon_get_path (icons, icon_sizes[i], name);
+
+		if (!g_file_test (path, G_FILE_TEST_EXISTS)) {
+			if (!icon_write (pixbuf, icon_sizes[i], path)) {
+				g_free (path);
+				g_clear_pointer (&name, g_free);
+				break;
+			}
+			icons->changed = TRUE;
+		}
+
+		g_free (path);
+	}
+
+	if (name)
+		g_hash_table_add (icons->installed, g_strdup (name));
+
+	g_object_unref (pixbuf);
+
+	return name;
+}
+
+static void
+icon_cache_updated_cb (GPid pid, gint status, gpointer data)
+{
+	IconCacheUpdate *update = (IconCacheUpdate *)data;
+
+	g_spawn_close_pid (pid);
+
+	update->func (update->data);
+	g_free (update);
+}
+
+/* removes icons that were not installed again and refreshes the cache
+ * in the background; returns TRUE when func will be called once the
+ * cache is written */
+gboolean
+favicon_icons_commit (FaviconIcons         *icons,
+                      FaviconIconsDoneFunc  func,
+                      gpointer              data)
+{
+	g_return_val_if_fail (icons != NULL && func != NULL, FALSE);
+
+	gchar *argv[] = { "gtk-update-icon-cache", "-f", "-t", "-q", icons->theme_dir, NULL };
+	gboolean ret = FALSE;
+	GPid pid;
+	GError *error = NULL;
+
+	icons_prune (icons);
+
+	if (!icons->changed)
+		return FALSE;
+
+	if (replay_trace_is_active ()) {
+		gchar *cmdline = g_strjoinv (" ", argv);
+		replay_trace_record ("spawn", cmdline, NULL);
+		g_free (cmdline);
+	} else if (g_spawn_async (NULL, argv, NULL,
+                              G_SPAWN_SEARCH_PATH |
+                              G_SPAWN_DO_NOT_REAP_CHILD |
+                              G_SPAWN_STDOUT_TO_DEV_NULL |
+                              G_SPAWN_STDERR_TO_DEV_NULL,
+                              NULL, NULL, &pid, &error)) {
+		IconCacheUpdate *update = g_new0 (IconCacheUpdate, 1);
+		update->func = func;
+		update->data = data;
+		g_child_watch_add (pid, icon_cache_updated_cb, update);
+		ret = TRUE;
+	} else {
+		g_warning ("Could not update the icon cache: %s", error->message);
+		g_error_free (error);
+	}
+
+	icons->changed = FALSE;
+
+	return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __FAVICON_ICONS_H__
+#define	__FAVICON_ICONS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FaviconIcons FaviconIcons;
+
+typedef void (*FaviconIconsDoneFunc) (gpointer data);
+
+FaviconIcons *favicon_icons_new      (void);
+
+void          favicon_icons_free     (FaviconIcons *icons);
+
+gchar        *favicon_icons_install  (FaviconIcons *icons,
+                                      const gchar  *file);
+
+gboolean      favicon_icons_commit   (FaviconIcons         *icons,
+                                      FaviconIconsDoneFunc  func,
+                                      gpointer              data);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <json-c/json.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "login_timing.h"
+#include "metrics.h"
+
+#define	LOGIN_TIMING_FILE		"autostart-timing.json"
+
+/* phases that never complete (e.g. a D-Bus reply that never
+ * arrives) must not keep the record from being written */
+#define	LOGIN_TIMING_FLUSH_TIMEOUT	30
+
+
+typedef struct {
+	gchar    *name;
+	gchar    *detail;
+	gint64    begin;
+	gint64    end;
+	gboolean  success;
+} LoginPhase;
+
+
+static GPtrArray *phases = NULL;
+static gint64 login_begin = 0;
+static gint64 login_begin_real = 0;
+static guint open_phases = 0;
+static gboolean finished = FALSE;
+static guint flush_timeout_id = 0;
+
+
+
+
+static void
+login_phase_free (LoginPhase *phase)
+{
+	g_free (phase->name);
+	g_free (phase->detail);
+	g_free (phase);
+}
+
+static gdouble
+usec_to_msec (gint64 usec)
+{
+	return (gdouble)usec / 1000.0;
+}
+
+static json_object *
+login_timing_to_json (gint64 now)
+{
+	guint i;
+	json_object *root_obj, *phases_obj;
+
+	root_obj = json_object_new_object ();
+	json_object_object_add (root_obj, "program", json_object_new_string (PACKAGE_NAME));
+	json_object_object_add (root_obj, "version", json_object_new_string (PACKAGE_VERSION));
+	json_object_object_add (root_obj, "user", json_object_new_string (g_get_user_name ()));
+	json_object_object_add (root_obj, "start", json_object_new_int64 (login_begin_real / G_USEC_PER_SEC));
+	json_object_object_add (root_obj, "total_ms", json_object_new_double (usec_to_msec (now - login_begin)));
+
+	phases_obj = json_object_new_array ();
+	for (i = 0; i < phases->len; i++) {
+		LoginPhase *phase = g_ptr_array_index (phases, i);
+		json_object *phase_obj = json_object_new_object ();
+
+		json_object_object_add (phase_obj, "name", json_object_new_string (phase->name));
+		if (phase->detail)
+			json_object_object_add (phase_obj, "detail", json_object_new_string (phase->detail));
+		json_object_object_add (phase_obj, "start_ms", json_object_new_double (usec_to_msec (phase->begin - login_begin)));
+
+		if (phase->end > 0) {
+			json_object_object_add (phase_obj, "duration_ms", json_object_new_double (usec_to_msec (phase->end - phase->begin)));
+			json_object_object_add (phase_obj, "success", json_object_new_boolean (phase->success));
+		} else {
+			/* still running when the record was flushed */
+			json_object_object_add (phase_obj, "duration_ms", NULL);
+			json_object_object_add (phase_obj, "success", json_object_new_boolean (FALSE));
+		}
+
+		json_object_array_add (phases_obj, phase_obj);
+	}
+	json_object_object_add (root_obj, "phases", phases_obj);
+
+	return root_obj;
+}
+
+static void
+login_timing_emit (void)
+{
+	gint64 now;
+	gchar *dir, *file;
+	const gchar *record;
+	json_object *root_obj;
+
+	now = g_get_monotonic_time ();
+	root_obj = login_timing_to_json (now);
+
+	metrics_observe ("login.total", usec_to_msec (now - login_begin));
+	record = json_object_to_json_string_ext (root_obj, JSON_C_TO_STRING_PLAIN);
+
+	/* one record per login in the journal ... */
+#if GLIB_CHECK_VERSION(2,50,0)
+	gchar total[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_ascii_dtostr (total, sizeof (total), usec_to_msec (now - login_begin));
+	g_log_structured (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,
+                      "GOOROOM_LOGIN_TOTAL_MS", total,
+                      "GOOROOM_LOGIN_TIMING", record,
+                      "MESSAGE", "Login configuration finished in %s ms", total);
+#else
+	g_message ("Login configuration finished: %s", record);
+#endif
+
+	/* ... and the same record under $XDG_RUNTIME_DIR */
+	dir = g_build_filename (g_get_user_runtime_dir (), "gooroom", NULL);
+	if (g_mkdir_with_parents (dir, 0700) == 0) {
+		file = g_build_filename (dir, LOGIN_TIMING_FILE, NULL);
+		g_file_set_contents (file, record, -1, NULL);
+		g_free (file);
+	}
+	g_free (dir);
+
+	json_object_put (root_obj);
+}
+
+static void
+login_timing_reset (void)
+{
+	if (flush_timeout_id) {
+		g_source_remove (flush_timeout_id);
+		flush_timeout_id = 0;
+	}
+
+	if (phases) {
+		g_ptr_array_free (phases, TRUE);
+		phases = NULL;
+	}
+
+	open_phases = 0;
+	finished = FALSE;
+}
+
+static gboolean
+login_timing_flush_timeout_cb (gpointer data)
+{
+	flush_timeout_id = 0;
+
+	login_timing_emit ();
+	login_timing_reset ();
+
+	return FALSE;
+}
+
+static void
+login_timing_try_emit (void)
+{
+	if (!finished || open_phases > 0)
+		return;
+
+	login_timing_emit ();
+	login_timing_reset ();
+}
+
+void
+login_timing_start (void)
+{
+	login_timing_reset ();
+
+	phases = g_ptr_array_new_with_free_func ((GDestroyNotify) login_phase_free);
+	login_begin = g_get_monotonic_time ();
+	login_begin_real = g_get_real_time ();
+}
+
+guint
+login_timing_begin (const gchar *phase, const gchar *detail)
+{
+	g_return_val_if_fail (phase != NULL, 0);
+
+	LoginPhase *p;
+
+	/* phases started after the record has been written are not tracked */
+	if (!phases)
+		return 0;
+
+	p = g_new0 (LoginPhase, 1);
+	p->name = g_strdup (phase);
+	p->detail = g_strdup (detail);
+	p->begin = g_get_monotonic_time ();
+
+	g_ptr_array_add (phases, p);
+	open_phases++;
+
+	return phases->len;
+}
+
+void
+login_timing_end (guint id, gboolean success)
+{
+	gchar *name;
+	LoginPhase *p;
+
+	if (!phases || id == 0 || id > phases->len)
+		return;
+
+	p = g_ptr_array_index (phases, id - 1);
+	if (p->end > 0)
+		return;
+
+	p->end = g_get_monotonic_time ();
+	p->success = success;
+	open_phases--;
+
+	/* repeated phases, e.g. downloads, share one histogram */
+	name = g_strconcat ("login.", p->name, NULL);
+	metrics_observe (name, usec_to_msec (p->end - p->begin));
+	g_free (name);
+
+	login_timing_try_emit ();
+}
+
+void
+login_timing_finish (void)
+{
+	if (!phases)
+		return;
+
+	finished = TRUE;
+
+	if (open_phases > 0) {
+		flush_timeout_id = g_timeout_add_seconds (LOGIN_TIMING_FLUSH_TIMEOUT,
+                                                  login_timing_flush_timeout_cb, NULL);
+		return;
+	}
+
+	login_timing_try_emit ();
+}
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <pwd.h>
+#include <signal.h>
 #include <sys/stat.h>
 
 #include <dbus/dbus.h>
@@ -44,145 +45,133 @@
 #include <gconf/gconf-client.h>
 
 #include "dockitem_file_template.h"
+#include "agent_client.h"
+#include "asset_cache.h"
+#include "downloader.h"
+#include "favicon_icons.h"
+#include "login_timing.h"
+#include "metrics.h"
+#include "replay_trace.h"
+#include "session_config.h"
+#include "staged_dir.h"
+#include "systemd_client.h"
+#include "task_graph.h"
+#include "wallpaper_variants.h"
+#include "xfconf_writer.h"
 
-#define	GRM_USER		".grm-user"
 
 
-static guint timeout_id = 0;
-static gint not_matched_count = 0;
-static GDBusProxy *agent_proxy = NULL;
+#define	DOCKBARX_GCONF_DIR				"/apps/dockbarx"
+#define	DOCKBARX_LAUNCHERS_KEY			"/apps/dockbarx/launchers"
 
+/* seconds to wait for the launchers to land in GConf */
+#define	LAUNCHER_VERIFICATION_TIMEOUT	2
 
+#define	GRAC_SERVICE_NAME				"grac-device-daemon.service"
+/* upper bound for the whole polkit + ReloadUnit chain, in seconds */
+#define	GRAC_RELOAD_TIMEOUT				30
+#define	GRAC_RELOAD_CALL_TIMEOUT		(25 * 1000)
 
+/* seconds to wait for the agent's replies */
+#define	AGENT_SETTINGS_TIMEOUT			30
 
-static gboolean
-authenticate (const gchar *action_id)
-{
-	GPermission *permission;
-	permission = polkit_permission_new_sync (action_id, NULL, NULL, NULL);
+/* milliseconds without a new agent signal of the same type before it is applied */
+#define	AGENT_SIGNAL_QUIET_TIME			300
 
-	if (!g_permission_get_allowed (permission)) {
-		if (g_permission_acquire (permission, NULL, NULL)) {
-			return TRUE;
-		}
-		return FALSE;
-	}
+/* milliseconds of quiet after a change of .grm-user before it is read again */
+#define	SESSION_CONFIG_RELOAD_DELAY		500
 
-	return TRUE;
-}
+/* seconds to wait for a service to appear on the bus before going on anyway */
+#define	BUS_NAME_GATE_TIMEOUT			60
 
-static void
-dpms_off_time_update (gint32 value, XfconfChannel *channel)
-{
-	if (value >= 0 && value <= 60) {
-		xfconf_channel_set_uint (channel, "/xfce4-power-manager/dpms-on-ac-off", value);
-		xfconf_channel_set_uint (channel, "/xfce4-power-manager/dpms-on-battery-off", value);
-	}
-}
 
-static GDBusProxy *
-agent_proxy_get (void)
-{
-	if (agent_proxy == NULL) {
-		agent_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-				G_DBUS_CALL_FLAGS_NONE,
-				NULL,
-				"kr.gooroom.agent",
-				"/kr/gooroom/agent",
-				"kr.gooroom.agent",
-				NULL,
-				NULL);
-	}
+typedef struct {
+	GConfClient *gconf;
+	GSList      *launchers;
+	guint        notify_id;
+	guint        deadline_id;
+} LauncherVerification;
 
-	return agent_proxy;
-}
 
-static gboolean
-get_object_path (gchar **object_path, const gchar *service_name)
-{
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
+typedef struct {
+	const gchar          *name;
+	GBusType              bus_type;
+	GBusNameWatcherFlags  flags;
+} BusName;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			"/org/freedesktop/systemd1",
-			"org.freedesktop.systemd1.Manager",
-			NULL, &error);
+typedef struct {
+	TaskGraphJob *job;
+	guint         watch_id;
+	guint         timeout_id;
+	guint         timing_id;
+} BusNameGate;
 
-	if (!proxy) {
-		g_error_free (error);
-		return FALSE;
-	}
 
-	variant = g_dbus_proxy_call_sync (proxy, "GetUnit",
-			g_variant_new ("(s)", service_name),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+typedef struct {
+	TaskGraphJob *job;
+	GCancellable *cancellable;
+	GPermission  *permission;
+	guint         timing_id;
+} GracReload;
 
-	if (!variant) {
-		g_error_free (error);
-	} else {
-		g_variant_get (variant, "(o)", object_path);
-		g_variant_unref (variant);
-	}
 
-	g_object_unref (proxy);
+static LauncherVerification *launcher_verification = NULL;
+static Downloader *asset_downloader = NULL;
+static AssetCache *asset_cache = NULL;
+static SessionConfig *session_config = NULL;
 
-	return TRUE;
-}
+/* the login jobs, until they have all finished */
+static TaskGraph *login_graph = NULL;
 
-static gboolean
-is_systemd_service_active (const gchar *service_name)
-{
-	gboolean ret = FALSE;
+/* --resident: the config last applied and the monitor for new ones */
+static gboolean resident = FALSE;
+static SessionConfig *applied_config = NULL;
+static GFileMonitor *session_config_monitor = NULL;
+static guint session_config_reload_id = 0;
+static GHashTable *fetched_favicons = NULL;
 
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
-	gchar      *obj_path = NULL;
-
-	get_object_path (&obj_path, service_name);
-	if (!obj_path) {
-		goto done;
-	}
-
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			obj_path,
-			"org.freedesktop.DBus.Properties",
-			NULL, &error);
-
-	if (!proxy)
-		goto done;
-
-	variant = g_dbus_proxy_call_sync (proxy, "GetAll",
-			g_variant_new ("(s)", "org.freedesktop.systemd1.Unit"),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-
-	if (variant) {
-		gchar *output = NULL;
-		GVariant *asv = g_variant_get_child_value(variant, 0);
-		GVariant *value = g_variant_lookup_value(asv, "ActiveState", NULL);
-		if(value && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
-			output = g_variant_dup_string(value, NULL);
-			if (g_strcmp0 (output, "active") == 0) {
-				ret = TRUE;;
-			}
-			g_free (output);
-		}
+/* a reload waiting for its downloads; changes meanwhile are picked up after it */
+typedef struct {
+	SessionConfig        *config;
+	SessionConfigChanges  changes;
+	gboolean              reload_again;
+} SessionConfigReapply;
 
-		g_variant_unref (variant);
-	}
+static SessionConfigReapply *session_config_reapplying = NULL;
 
-	g_object_unref (proxy);
+static GSettings *applauncher_settings = NULL;
 
-done:
-	if (error)
-		g_error_free (error);
+/* the dock restarts only once the favicons are in the icon cache */
+static guint icon_cache_updates = 0;
+static gboolean dock_restart_deferred = FALSE;
 
-	return ret;
+/* --config: the user's settings file instead of the one the agent writes */
+static gchar *config_file = NULL;
+
+/* --trace: an offline replay of a fixture instead of the live session */
+static gchar *replay_trace_file = NULL;
+static gchar *replay_assets = NULL;
+static gchar *replay_root = NULL;
+
+/* xfconfd is D-Bus activatable, so waiting for it also starts it */
+static const BusName xfconf_bus_name = { "org.xfce.Xfconf",  G_BUS_TYPE_SESSION,
+                                         G_BUS_NAME_WATCHER_FLAGS_AUTO_START };
+static const BusName panel_bus_name  = { "org.xfce.Panel",   G_BUS_TYPE_SESSION,
+                                         G_BUS_NAME_WATCHER_FLAGS_NONE };
+static const BusName agent_bus_name  = { "kr.gooroom.agent", G_BUS_TYPE_SYSTEM,
+                                         G_BUS_NAME_WATCHER_FLAGS_NONE };
+
+
+
+
+static void
+dpms_off_time_update (gint32 value, XfconfWriter *power)
+{
+	if (value >= 0 && value <= 60) {
+		xfconf_writer_set_uint (power, "/xfce4-power-manager/dpms-on-ac-off", value);
+		xfconf_writer_set_uint (power, "/xfce4-power-manager/dpms-on-battery-off", value);
+		xfconf_writer_commit (power);
+	}
 }
 
 json_object *
@@ -197,27 +186,6 @@ JSON_OBJECT_GET (json_object *root_obj, const char *key)
 	return ret_obj;
 }
 
-static gchar *
-get_grm_user_data (void)
-{
-	gchar *file = NULL;
-	gchar *data = NULL;
-
-	file = g_strdup_printf ("/var/run/user/%d/gooroom/%s", getuid (), GRM_USER);
-
-	if (!g_file_test (file, G_FILE_TEST_EXISTS)) {
-		g_error ("No such file or directory : %s", file);
-		goto error;
-	}
-	
-	g_file_get_contents (file, &data, NULL, NULL);
-
-error:
-	g_free (file);
-
-	return data;
-}
-
 static long
 strtoday (const char *date /* yyyy-mm-dd */)
 {
@@ -237,25 +205,73 @@ strtoday (const char *date /* yyyy-mm-dd */)
 	return -1;
 }
 
+static Downloader *
+asset_downloader_new (void)
+{
+	Downloader *downloader = downloader_new ();
+
+	/* a replay takes everything from its fixture */
+	if (replay_assets)
+		downloader_set_asset_dir (downloader, replay_assets);
+
+	return downloader;
+}
+
 static gboolean
 download_with_curl (const gchar *download_url, const gchar *download_path)
 {
 	gboolean ret = FALSE;
+	Downloader *downloader;
 
 	if (!download_url || !download_path)
 		return FALSE;
 
-	gchar *cmd = g_find_program_in_path ("wget");
-	if (cmd) {
-		gchar *cmdline = g_strdup_printf ("%s --no-check-certificate %s -q -O %s", cmd, download_url, download_path);
-		ret = g_spawn_command_line_sync (cmdline, NULL, NULL, NULL, NULL);
-		g_free (cmdline);
+	/* reuse the connections of this login's asset downloads if possible */
+	downloader = asset_downloader ? asset_downloader : asset_downloader_new ();
+
+	/* already fetched together with the other assets */
+	if (!downloader_lookup (downloader, download_url, download_path, &ret)) {
+		downloader_add (downloader, download_url, download_path);
+		downloader_run (downloader);
+		downloader_lookup (downloader, download_url, download_path, &ret);
 	}
-	g_free (cmd);
+
+	if (downloader != asset_downloader)
+		downloader_free (downloader);
 
 	return ret;
 }
 
+static gchar *
+get_favicon_path (gint num)
+{
+	return g_strdup_printf ("%s/favicon-%.02d", g_get_user_cache_dir (), num);
+}
+
+static gchar *
+get_wallpaper_download_path (const gchar *wallpaper_url)
+{
+	g_return_val_if_fail (wallpaper_url != NULL, NULL);
+
+	gchar *wallpaper_path = NULL;
+
+	/* obtain filename from url */
+	const gchar *filename = g_strrstr (wallpaper_url, "/");
+	if (filename) {
+		gchar *background_dir = g_build_filename (g_get_user_data_dir (), "backgrounds", NULL);
+		if (!g_file_test (background_dir, G_FILE_TEST_EXISTS)) {
+			g_mkdir_with_parents (background_dir, 0744);
+		}
+
+		/* build download path */
+		wallpaper_path = g_build_filename (background_dir, filename + 1, NULL);
+
+		g_free (background_dir);
+	}
+
+	return wallpaper_path;
+}
+
 static gchar *
 download_favicon (const gchar *favicon_url, gint num)
 {
@@ -263,11 +279,19 @@ download_favicon (const gchar *favicon_url, gint num)
 
 	gchar *favicon_path = NULL;
 
-	favicon_path = g_strdup_printf ("%s/favicon-%.02d", g_get_user_cache_dir (), num);
-	g_remove (favicon_path);
+	favicon_path = get_favicon_path (num);
 
-	if (!download_with_curl (favicon_url, favicon_path))
-		goto error;
+	/* unchanged launchers keep what an earlier pass of this process fetched */
+	if (!fetched_favicons ||
+        g_strcmp0 (g_hash_table_lookup (fetched_favicons, favicon_path), favicon_url) != 0 ||
+        !g_file_test (favicon_path, G_FILE_TEST_EXISTS)) {
+		if (!download_with_curl (favicon_url, favicon_path))
+			goto error;
+
+		if (!fetched_favicons)
+			fetched_favicons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		g_hash_table_replace (fetched_favicons, g_strdup (favicon_path), g_strdup (favicon_url));
+	}
 
 	if (!g_file_test (favicon_path, G_FILE_TEST_EXISTS))
 		goto error;
@@ -316,18 +340,11 @@ has_application (GList *list, GAppInfo *appinfo)
 }
 
 static gchar *
-get_desktop_directory (json_object *obj)
+get_desktop_directory (void)
 {
-	g_return_val_if_fail (obj != NULL, NULL);
-
 	gchar *desktop_dir = NULL;
-	const char *val = json_object_get_string (obj);
 
-	if (g_strcmp0 (val, "bar") == 0) {
-		desktop_dir = g_build_filename (g_get_user_data_dir (), "applications/custom", NULL);
-	} else {
-		desktop_dir = g_build_filename (g_get_user_data_dir () ,"applications", NULL);
-	}
+	desktop_dir = g_build_filename (g_get_user_data_dir () ,"applications", NULL);
 
 	if (!g_file_test (desktop_dir, G_FILE_TEST_EXISTS)) {
 		if (g_mkdir_with_parents (desktop_dir, 0755) == -1) {
@@ -339,50 +356,37 @@ get_desktop_directory (json_object *obj)
 	return desktop_dir;
 }
 
-static gboolean
-create_desktop_file (json_object *obj, const gchar *dt_file_name, gint num)
+static gchar *
+build_desktop_file_data (SessionApp *app, FaviconIcons *icons)
 {
-	g_return_val_if_fail ((obj != NULL) || (dt_file_name != NULL), FALSE);
-
-	gboolean ret = FALSE;
+	gchar *data = NULL;
 	GKeyFile *keyfile = NULL;
 
 	keyfile = g_key_file_new ();
 
-	json_object_object_foreach (obj, key, val) {
-		const gchar *value = json_object_get_string (val);
-		gchar *d_key = g_ascii_strdown (key, -1);
-
-		if (d_key && g_strcmp0 (d_key, "icon") == 0) {
-			if (g_str_has_prefix (value, "http://") || g_str_has_prefix (value, "https://")) {
-				gchar *icon_file = download_favicon (value, num);
-				if (icon_file) {
-					g_key_file_set_string (keyfile, "Desktop Entry", "Icon", icon_file);
-					g_free (icon_file);
-				} else {
-					g_key_file_set_string (keyfile, "Desktop Entry", "Icon", "applications-other");
-				}
-			} else {
-				g_key_file_set_string (keyfile, "Desktop Entry", "Icon", value);
-			}
+	if (app->name)
+		g_key_file_set_string (keyfile, "Desktop Entry", "Name", app->name);
+	if (app->comment)
+		g_key_file_set_string (keyfile, "Desktop Entry", "Comment", app->comment);
+	if (app->exec)
+		g_key_file_set_string (keyfile, "Desktop Entry", "Exec", app->exec);
+
+	if (app->icon) {
+		if (session_app_has_remote_icon (app)) {
+			gchar *icon_name = NULL;
+			gchar *icon_file = download_favicon (app->icon, app->index);
+
+			/* consumers load the pre-sized icon by name */
+			if (icon_file && g_path_is_absolute (icon_file))
+				icon_name = favicon_icons_install (icons, icon_file);
+
+			g_key_file_set_string (keyfile, "Desktop Entry", "Icon",
+                                   icon_name ? icon_name : "applications-other");
+			g_free (icon_name);
+			g_free (icon_file);
 		} else {
-			gchar *new_key = NULL;
-
-			if (g_strcmp0 (d_key, "name") == 0) {
-				new_key = g_strdup ("Name");
-			} else if (g_strcmp0 (d_key, "comment") == 0) {
-				new_key = g_strdup ("Comment");
-			} else if (g_strcmp0 (d_key, "exec") == 0) {
-				new_key = g_strdup ("Exec");
-			}
-
-			if (new_key) {
-				g_key_file_set_string (keyfile, "Desktop Entry", new_key, value);
-				g_free (new_key);
-			}
+			g_key_file_set_string (keyfile, "Desktop Entry", "Icon", app->icon);
 		}
-
-		g_free (d_key);
 	}
 
 	g_key_file_set_string (keyfile, "Desktop Entry", "Type", "Application");
@@ -391,75 +395,63 @@ create_desktop_file (json_object *obj, const gchar *dt_file_name, gint num)
 	/* we don't want to show in application launcher */
 	g_key_file_set_string (keyfile, "Desktop Entry", "NoDisplay", "true");
 
-	ret = g_key_file_save_to_file (keyfile, dt_file_name, NULL);
+	data = g_key_file_to_data (keyfile, NULL, NULL);
 	g_key_file_free (keyfile);
 
-	return ret;
+	return data;
 }
 
 static gboolean
-desktop_has_name (const gchar *id, const gchar *name)
+create_desktop_file (const gchar *data, const gchar *dt_file_name)
 {
-	gboolean ret = FALSE;
-
-	gchar *desktop = g_build_filename ("/usr/share/applications", id, NULL);
-	GKeyFile *keyfile = g_key_file_new ();
-
-    if (g_key_file_load_from_file (keyfile,
-                                   desktop,
-                                   G_KEY_FILE_KEEP_COMMENTS |
-                                   G_KEY_FILE_KEEP_TRANSLATIONS,
-                                   NULL)) {
-		gsize num_keys, i;
-		gchar **keys = g_key_file_get_keys (keyfile, "Desktop Entry", &num_keys, NULL);
-
-		for (i = 0; i < num_keys; i++) {
-			if (!g_str_has_prefix (keys[i], "Name"))
-				continue;
+	g_return_val_if_fail ((data != NULL) && (dt_file_name != NULL), FALSE);
 
-			gchar *value = g_key_file_get_value (keyfile, "Desktop Entry", keys[i], NULL);
-			if (value) {
-				if (strstr (value, name) != NULL) {
-					ret = TRUE;
-				}
-			}
-			g_free (value);
-		}
-		g_strfreev (keys);
+	gboolean ret = FALSE;
+	gchar *old_data = NULL;
+
+	if (replay_trace_is_active ()) {
+		replay_trace_record ("file", dt_file_name, data);
+		ret = TRUE;
+	} else if (g_file_get_contents (dt_file_name, &old_data, NULL, NULL) &&
+               g_strcmp0 (old_data, data) == 0) {
+		/* files that are already up to date are left untouched */
+		ret = TRUE;
+	} else {
+		ret = g_file_set_contents (dt_file_name, data, -1, NULL);
 	}
-	g_key_file_free (keyfile);
-	g_free (desktop);
+
+	g_free (old_data);
 
 	return ret;
 }
 
-static gchar *
-find_desktop_by_id (GList *apps, const gchar *find_str)
+static void
+remove_stale_desktop_files (const gchar *dt_dir_name, GHashTable *dt_files)
 {
-	GList *l = NULL;
-	gchar *ret = NULL;
+	GDir *dir;
+	const gchar *file;
 
-	if (!find_str || g_str_equal (find_str, ""))
-		return NULL;
+	dir = g_dir_open (dt_dir_name, 0, NULL);
+	if (G_UNLIKELY (dir == NULL))
+		return;
 
-	for (l = apps; l; l = l->next) {
-		GAppInfo *appinfo = G_APP_INFO (l->data);
-		if (appinfo) { 
-			const gchar *id = g_app_info_get_id (appinfo);
+	while ((file = g_dir_read_name (dir)) != NULL) {
+		gchar *path;
 
-			if (g_str_equal (id, find_str)) {
-				ret = g_strdup (id);
-				break;
-			}
+		if (!g_str_has_prefix (file, "shortcut-") || !g_str_has_suffix (file, ".desktop"))
+			continue;
 
-			if (desktop_has_name (id, find_str)) {
-				ret = g_strdup (id);
-				break;
-			}
+		path = g_build_filename (dt_dir_name, file, NULL);
+		if (!g_hash_table_contains (dt_files, path)) {
+			if (replay_trace_is_active ())
+				replay_trace_record ("remove", path, NULL);
+			else
+				g_remove (path);
 		}
+		g_free (path);
 	}
 
-	return ret;
+	g_dir_close (dir);
 }
 
 static gchar *
@@ -520,41 +512,101 @@ get_blacklist_from_json (const gchar *data)
 	return ret;
 }
 
+static gboolean
+strv_equal (gchar **a, gchar **b)
+{
+	guint i;
+
+	if (g_strv_length (a) != g_strv_length (b))
+		return FALSE;
+
+	for (i = 0; a[i]; i++) {
+		if (g_strcmp0 (a[i], b[i]) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* looked up once; NULL when the applauncher plugin is not installed */
+static GSettings *
+applauncher_settings_get (void)
+{
+	static gboolean looked_up = FALSE;
+
+	if (!looked_up) {
+		GSettingsSchema *schema;
+
+		looked_up = TRUE;
+
+		schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
+                                                  "apps.gooroom-applauncher-plugin",
+                                                  TRUE);
+		if (schema) {
+			applauncher_settings = g_settings_new_full (schema, NULL, NULL);
+			/* changes reach dconf, and the applauncher, only on g_settings_apply () */
+			g_settings_delay (applauncher_settings);
+			g_settings_schema_unref (schema);
+		}
+	}
+
+	return applauncher_settings;
+}
+
 static void
 save_application_blacklist (gchar *blacklist)
 {
 	g_return_if_fail (blacklist != NULL);
 
-	GSettingsSchema *schema;
+	gchar **filters, **current;
+	GSettings *settings;
 
-	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
-                                              "apps.gooroom-applauncher-plugin",
-                                              TRUE);
-	if (schema) {
-		gchar **filters;
-		GSettings *settings;
+	settings = applauncher_settings_get ();
+	if (!settings)
+		return;
 
-		filters = g_strsplit (blacklist, ",", -1);
+	filters = g_strsplit (blacklist, ",", -1);
+	current = g_settings_get_strv (settings, "blacklist");
 
-		settings = g_settings_new_full (schema, NULL, NULL);
+	if (!strv_equal (current, filters)) {
 		g_settings_set_strv (settings, "blacklist", (const char * const *) filters);
-		g_object_unref (settings);
+		g_settings_apply (settings);
+		metrics_count ("gsettings.writes", 1);
+	}
 
-		g_strfreev (filters);
+	g_strfreev (current);
+	g_strfreev (filters);
+}
 
-		g_settings_schema_unref (schema);
+/* a replay only records the command */
+static void
+spawn_command_line (const gchar *cmdline, gboolean wait)
+{
+	if (replay_trace_is_active ()) {
+		replay_trace_record ("spawn", cmdline, NULL);
+	} else if (wait) {
+		g_spawn_command_line_sync (cmdline, NULL, NULL, NULL, NULL);
+	} else {
+		g_spawn_command_line_async (cmdline, NULL);
 	}
 }
 
 static gboolean
 restart_dockbarx_async (gpointer data)
 {
-	g_spawn_command_line_sync ("xfce4-panel -r", NULL, NULL, NULL, NULL);
+	if (icon_cache_updates > 0) {
+		dock_restart_deferred = TRUE;
+		return FALSE;
+	}
+
+	metrics_count ("panel.restarts", 1);
+
+	spawn_command_line ("xfce4-panel -r", TRUE);
 
 	gchar *cmd = g_find_program_in_path ("pkill");
 	if (cmd) {
 		gchar *cmdline = g_strdup_printf ("%s -f 'python.*xfce4-dockbarx-plug'", cmd);
-		g_spawn_command_line_async (cmdline, NULL);
+		spawn_command_line (cmdline, FALSE);
 		g_free (cmdline);
 	}
 	g_free (cmd);
@@ -562,6 +614,17 @@ restart_dockbarx_async (gpointer data)
 	return FALSE;
 }
 
+static void
+icon_cache_updated_cb (gpointer data)
+{
+	icon_cache_updates--;
+
+	if (icon_cache_updates == 0 && dock_restart_deferred) {
+		dock_restart_deferred = FALSE;
+		restart_dockbarx_async (NULL);
+	}
+}
+
 static gboolean
 find_launcher (GSList *list, const gchar *launcher)
 {
@@ -576,36 +639,49 @@ find_launcher (GSList *list, const gchar *launcher)
 	return FALSE;
 }
 
+static gboolean
+string_list_equal (GSList *list1, GSList *list2)
+{
+	for (; list1 && list2; list1 = list1->next, list2 = list2->next) {
+		if (g_strcmp0 ((gchar *)list1->data, (gchar *)list2->data) != 0)
+			return FALSE;
+	}
+
+	return (list1 == NULL && list2 == NULL);
+}
+
 static void
 dockbarx_launchers_set (GSList *launchers)
 {
 	g_return_if_fail (launchers != NULL);
 
-	guint i = 0;
-	GSList *l = NULL;
-	gchar **array = NULL;
-	gchar *cmd, *cmdline;
-
-//	gconftool-2 --type list --list-type string --set /apps/dockbarx/launchers '[glade;/usr/share/applications/gparted.desktop]'";
-	cmd = g_find_program_in_path ("gconftool-2");
-
-	array = g_new0 (gchar *, g_slist_length (launchers) + 1);
+	GError *error = NULL;
+	GConfClient *gconf;
+	GSList *old_launchers;
 
-	for (l = launchers; l; l = l->next) {
-		array[i++] = g_strdup ((gchar *)l->data);
+	if (replay_trace_is_active ()) {
+		replay_trace_record_list ("gconf", DOCKBARX_LAUNCHERS_KEY, launchers);
+		return;
 	}
-	array[i] = NULL;
 
-	gchar *strlist = g_strjoinv (",", array);
+	gconf = gconf_client_get_default ();
 
-	cmdline = g_strdup_printf ("%s --type list --list-type string --set /apps/dockbarx/launchers '[%s]'", cmd, strlist);
+	/* every change makes the dock reload, so skip writes that change nothing */
+	old_launchers = gconf_client_get_list (gconf, DOCKBARX_LAUNCHERS_KEY, GCONF_VALUE_STRING, NULL);
 
-	g_spawn_command_line_sync (cmdline, NULL, NULL, NULL, NULL);
+	if (!string_list_equal (old_launchers, launchers)) {
+		/* the whole list is replaced as one value */
+		if (gconf_client_set_list (gconf, DOCKBARX_LAUNCHERS_KEY, GCONF_VALUE_STRING, launchers, &error)) {
+			gconf_client_suggest_sync (gconf, NULL);
+			metrics_count ("gconf.writes", 1);
+		} else {
+			g_warning ("Failed to set %s: %s", DOCKBARX_LAUNCHERS_KEY, error->message);
+			g_error_free (error);
+		}
+	}
 
-	g_free (cmd);
-	g_free (cmdline);
-	g_free (strlist);
-	g_strfreev (array);
+	g_slist_free_full (old_launchers, (GDestroyNotify) g_free);
+	g_object_unref (gconf);
 }
 
 static GSList *
@@ -614,9 +690,13 @@ dockbarx_launchers_get (void)
 	GConfClient *gconf;
 	GSList *old_launchers, *new_launchers = NULL;
 
+	/* a replay starts from an empty dock */
+	if (replay_trace_is_active ())
+		return NULL;
+
 	gconf = gconf_client_get_default ();
 
-	old_launchers = gconf_client_get_list (gconf, "/apps/dockbarx/launchers", GCONF_VALUE_STRING, NULL);
+	old_launchers = gconf_client_get_list (gconf, DOCKBARX_LAUNCHERS_KEY, GCONF_VALUE_STRING, NULL);
 
 	GSList *l = NULL;
 	for (l = old_launchers; l != NULL; l = l->next) {
@@ -713,23 +793,10 @@ icon_theme_exists (const gchar *icon_theme)
 }
 
 static gboolean
-check_dockbarx_launchers (gpointer data)
+dockbarx_launchers_applied (GSList *new_launchers)
 {
-	if (!data) {
-		if (timeout_id) {
-			g_source_remove (timeout_id);
-			timeout_id = 0;
-		}
-		not_matched_count = 0;
-
-		g_timeout_add (500, (GSourceFunc) restart_dockbarx_async, NULL);
-
-		return FALSE;
-	}
-
 	gboolean matched = TRUE;
 	GSList *l = NULL;
-	GSList *new_launchers = (GSList *)data;
 	GSList *old_launchers = dockbarx_launchers_get ();
 
 	// old_launchers and new_launchers must be same
@@ -743,157 +810,246 @@ check_dockbarx_launchers (gpointer data)
 
 	g_slist_free_full (old_launchers, (GDestroyNotify) g_free);
 
-	if (!matched) {
-		if (not_matched_count > 3) {
-			if (timeout_id) {
-				g_source_remove (timeout_id);
-				timeout_id = 0;
-			}
+	return matched;
+}
+
+static void
+launcher_verification_finish (gboolean matched)
+{
+	LauncherVerification *verification = launcher_verification;
 
-			not_matched_count = 0;
+	if (!verification)
+		return;
 
-			GtkWidget *dialog = gtk_message_dialog_new (NULL,
-					GTK_DIALOG_MODAL,
-					GTK_MESSAGE_ERROR,
-					GTK_BUTTONS_OK,
-					_("User Configuration Error"));
+	launcher_verification = NULL;
 
-			gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
-					_("Failed to set user's favorite menu.\nPlease login again."));
-			gtk_window_set_title (GTK_WINDOW (dialog), _("Warning"));
-			gtk_window_set_position (GTK_WINDOW (dialog), GTK_WIN_POS_CENTER);
+	if (verification->deadline_id)
+		g_source_remove (verification->deadline_id);
 
-			g_signal_connect (dialog, "response", G_CALLBACK (gtk_widget_destroy), NULL);
+	if (verification->notify_id) {
+		gconf_client_notify_remove (verification->gconf, verification->notify_id);
+		gconf_client_remove_dir (verification->gconf, DOCKBARX_GCONF_DIR, NULL);
+	}
 
-			gtk_widget_show (dialog);
+	g_object_unref (verification->gconf);
+	g_slist_free_full (verification->launchers, (GDestroyNotify) g_free);
+	g_free (verification);
 
-			return FALSE;
-		}
+	if (!matched) {
+		GtkWidget *dialog = gtk_message_dialog_new (NULL,
+				GTK_DIALOG_MODAL,
+				GTK_MESSAGE_ERROR,
+				GTK_BUTTONS_OK,
+				_("User Configuration Error"));
 
-		not_matched_count++;
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+				_("Failed to set user's favorite menu.\nPlease login again."));
+		gtk_window_set_title (GTK_WINDOW (dialog), _("Warning"));
+		gtk_window_set_position (GTK_WINDOW (dialog), GTK_WIN_POS_CENTER);
 
-		return TRUE;
-	}
+		g_signal_connect (dialog, "response", G_CALLBACK (gtk_widget_destroy), NULL);
 
-	if (timeout_id) {
-		g_source_remove (timeout_id);
-		timeout_id = 0;
-	}
+		gtk_widget_show (dialog);
 
-	not_matched_count = 0;
+		return;
+	}
 
-	g_slist_free_full (new_launchers, (GDestroyNotify) g_free);
 	g_timeout_add (500, (GSourceFunc) restart_dockbarx_async, NULL);
-
-	return FALSE;
 }
 
 static void
-make_direct_url (json_object *root_obj, GSList *launchers)
-{
-	g_return_if_fail (root_obj != NULL);
-
-	json_object *apps_obj = NULL;
-	apps_obj = JSON_OBJECT_GET (root_obj, "apps");
-
-	g_return_if_fail (apps_obj != NULL);
-
-	gint i = 0, len = 0;;
-	len = json_object_array_length (apps_obj);
-
-	for (i = 0; i < len; i++) {
-		json_object *app_obj = json_object_array_get_idx (apps_obj, i);
-
-		if (app_obj) {
-			gchar *dt_file_name = NULL;
-			json_object *dt_obj = NULL, *pos_obj = NULL;
-			dt_obj = JSON_OBJECT_GET (app_obj, "desktop");
-			pos_obj = JSON_OBJECT_GET (app_obj, "position");
-
-			if (dt_obj && pos_obj) {
-				gchar *dt_dir_name = get_desktop_directory (pos_obj);
-				if (dt_dir_name) {
-					dt_file_name = g_strdup_printf ("%s/shortcut-%.02d.desktop", dt_dir_name, i);
-				}
-				g_free (dt_dir_name);
-
-				if (create_desktop_file (dt_obj, dt_file_name, i)) {
-					gchar *launcher = g_strdup_printf ("shortcut-%.02d;%s", i, dt_file_name);
-					if (!find_launcher (launchers, launcher)) {
-						launchers = g_slist_append (launchers, launcher);
-					}
-				} else {
-					g_error ("Could not create desktop file : %s", dt_file_name);
-				}
-			}
-			g_free (dt_file_name);
-		}
+dockbarx_launchers_changed_cb (GConfClient *client,
+                               guint        cnxn_id,
+                               GConfEntry  *entry,
+                               gpointer     data)
+{
+	if (launcher_verification &&
+        dockbarx_launchers_applied (launcher_verification->launchers)) {
+		launcher_verification_finish (TRUE);
 	}
 }
 
-static void
-remove_custom_desktop_files ()
+static gboolean
+launcher_verification_deadline_cb (gpointer data)
 {
-	gchar *remove_dir = g_build_filename (g_get_user_data_dir (), "applications/custom", NULL);
-    if (g_file_test (remove_dir, G_FILE_TEST_EXISTS)) {
-		gchar *cmd, *cmdline;
-
-		cmd = g_find_program_in_path ("rm");
-		cmdline = g_strdup_printf ("%s -rf %s", cmd, remove_dir);
-
-		g_spawn_command_line_sync (cmdline, NULL, NULL, NULL, NULL);
-
-		g_free (cmd);
-		g_free (cmdline);
+	if (launcher_verification) {
+		launcher_verification->deadline_id = 0;
+		launcher_verification_finish (dockbarx_launchers_applied (launcher_verification->launchers));
 	}
 
-	g_free (remove_dir);
+	return FALSE;
 }
 
+/* waits for the launchers to show up in GConf and restarts the dock */
 static void
-dock_launcher_update (void)
+launcher_verification_start (GSList *new_launchers)
 {
-	GSList *new_launchers = NULL;
-	gchar *data = get_grm_user_data ();
-
-	if (data) {
-		enum json_tokener_error jerr = json_tokener_success;
-		json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-		if (jerr == json_tokener_success) {
-			json_object *obj1 = NULL, *obj2 = NULL, *obj2_1 = NULL, *obj3= NULL;
-			obj1 = JSON_OBJECT_GET (root_obj, "data");
-			obj2 = JSON_OBJECT_GET (obj1, "loginInfo");
-			obj2_1 = JSON_OBJECT_GET (obj2, "user_id");
-			obj3 = JSON_OBJECT_GET (obj1, "desktopInfo");
-			if (obj2_1) {
-				const char *value = json_object_get_string (obj2_1);
-				if (g_strcmp0 (value, g_get_user_name ()) == 0) {
-					if (obj3) {
-						new_launchers = dockbarx_launchers_get ();
-						make_direct_url (obj3, new_launchers);
-						dockbarx_launchers_set (new_launchers);
-					}
-				}
-			}
-			json_object_put (root_obj);
-		}
+	LauncherVerification *verification;
+
+	/* a newer list replaces one that is still being verified */
+	if (launcher_verification) {
+		g_slist_free_full (launcher_verification->launchers, (GDestroyNotify) g_free);
+		launcher_verification->launchers = new_launchers;
+	} else {
+		verification = g_new0 (LauncherVerification, 1);
+		verification->gconf = gconf_client_get_default ();
+		verification->launchers = new_launchers;
+		launcher_verification = verification;
 	}
 
-	g_free (data);
+	verification = launcher_verification;
 
-	if (new_launchers) {
-		timeout_id = g_timeout_add (500, (GSourceFunc) check_dockbarx_launchers, new_launchers);
+	if (dockbarx_launchers_applied (verification->launchers)) {
+		launcher_verification_finish (TRUE);
+		return;
+	}
+
+	if (!verification->notify_id) {
+		gconf_client_add_dir (verification->gconf, DOCKBARX_GCONF_DIR,
+                              GCONF_CLIENT_PRELOAD_NONE, NULL);
+		verification->notify_id = gconf_client_notify_add (verification->gconf,
+                                                           DOCKBARX_LAUNCHERS_KEY,
+                                                           dockbarx_launchers_changed_cb,
+                                                           NULL, NULL, NULL);
 	}
+
+	if (verification->deadline_id)
+		g_source_remove (verification->deadline_id);
+
+	verification->deadline_id = g_timeout_add_seconds (LAUNCHER_VERIFICATION_TIMEOUT,
+                                                       launcher_verification_deadline_cb,
+                                                       NULL);
 }
 
-static gboolean
-is_online_user (const gchar *username)
+static GSList *
+make_direct_url (SessionConfig *config, GSList *launchers)
 {
-	gboolean ret = FALSE;
+	g_return_val_if_fail (config != NULL, launchers);
 
-	struct passwd *entry = getpwnam (username);
-	if (entry) {
-		gchar **tokens = g_strsplit (entry->pw_gecos, ",", -1);
+	guint i = 0;
+	gchar *dt_dir_name, *custom_dir_name;
+	GHashTable *dt_files, *custom_files;
+	FaviconIcons *icons;
+
+	dt_dir_name = get_desktop_directory ();
+	g_return_val_if_fail (dt_dir_name != NULL, launchers);
+
+	custom_dir_name = g_build_filename (dt_dir_name, "custom", NULL);
+
+	dt_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	custom_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	icons = favicon_icons_new ();
+
+	for (i = 0; i < config->apps->len; i++) {
+		SessionApp *app = g_ptr_array_index (config->apps, i);
+		gchar *dt_name, *dt_file_name, *data;
+
+		dt_name = g_strdup_printf ("shortcut-%.02d.desktop", app->index);
+		data = build_desktop_file_data (app, icons);
+
+		if (g_strcmp0 (app->position, "bar") == 0) {
+			/* published all at once below */
+			dt_file_name = g_build_filename (custom_dir_name, dt_name, NULL);
+			g_hash_table_replace (custom_files, g_strdup (dt_name), data);
+		} else {
+			dt_file_name = g_build_filename (dt_dir_name, dt_name, NULL);
+			if (!create_desktop_file (data, dt_file_name))
+				g_error ("Could not create desktop file : %s", dt_file_name);
+			g_hash_table_add (dt_files, g_strdup (dt_file_name));
+			g_free (data);
+		}
+
+		gchar *launcher = g_strdup_printf ("shortcut-%.02d;%s", app->index, dt_file_name);
+		if (!find_launcher (launchers, launcher)) {
+			launchers = g_slist_append (launchers, launcher);
+		} else {
+			g_free (launcher);
+		}
+
+		g_free (dt_file_name);
+		g_free (dt_name);
+	}
+
+	/* staged first, then applied to applications/custom in one pass */
+	if (!staged_dir_publish (custom_dir_name, custom_files))
+		g_warning ("Could not update desktop files in %s", custom_dir_name);
+
+	/* drop the shortcuts that are no longer configured */
+	remove_stale_desktop_files (dt_dir_name, dt_files);
+
+	/* and their icons; a dock restart waits for the cache update */
+	if (favicon_icons_commit (icons, icon_cache_updated_cb, NULL))
+		icon_cache_updates++;
+	favicon_icons_free (icons);
+
+	g_hash_table_destroy (custom_files);
+	g_hash_table_destroy (dt_files);
+	g_free (custom_dir_name);
+	g_free (dt_dir_name);
+
+	return launchers;
+}
+
+static void
+remove_custom_desktop_files ()
+{
+	guint timing_id = login_timing_begin ("remove_custom_desktop_files", NULL);
+
+	gboolean ret;
+	gchar *remove_dir = g_build_filename (g_get_user_data_dir (), "applications/custom", NULL);
+
+	ret = staged_dir_remove (remove_dir);
+
+	g_free (remove_dir);
+
+	login_timing_end (timing_id, ret);
+}
+
+/* the .grm-user of a replay stands for its own user */
+static gboolean
+is_session_owner (SessionConfig *config)
+{
+	if (replay_trace_is_active ())
+		return (config->user_id != NULL);
+
+	return session_config_is_owned_by (config, g_get_user_name ());
+}
+
+static void
+dock_launcher_update (SessionConfig *config)
+{
+	GSList *new_launchers = NULL;
+
+	if (is_session_owner (config)) {
+		new_launchers = dockbarx_launchers_get ();
+		new_launchers = make_direct_url (config, new_launchers);
+		if (new_launchers)
+			dockbarx_launchers_set (new_launchers);
+	} else {
+		remove_custom_desktop_files ();
+	}
+
+	if (new_launchers && replay_trace_is_active ()) {
+		/* nothing to verify against; record the restart right away */
+		restart_dockbarx_async (NULL);
+		g_slist_free_full (new_launchers, (GDestroyNotify) g_free);
+	} else if (new_launchers) {
+		launcher_verification_start (new_launchers);
+	}
+}
+
+static gboolean
+is_online_user (const gchar *username)
+{
+	gboolean ret = FALSE;
+
+	/* so is the user of a replay */
+	if (replay_trace_is_active ())
+		return TRUE;
+
+	struct passwd *entry = getpwnam (username);
+	if (entry) {
+		gchar **tokens = g_strsplit (entry->pw_gecos, ",", -1);
 		if (g_strv_length (tokens) > 4 ) {
 			if (tokens[4] && (g_strcmp0 (tokens[4], "gooroom-online-account") == 0)) {
 				ret = TRUE;
@@ -905,23 +1061,14 @@ is_online_user (const gchar *username)
 	return ret;
 }
 
-static void
-list_sorted (gpointer key, gpointer value, gpointer user_data)
-{
-  GSList **listp = user_data;
-
-  *listp = g_slist_insert_sorted (*listp, key, (GCompareFunc) g_utf8_collate);
-}
-
 static void
 set_icon_theme (const gchar *icon_theme)
 {
-	XfconfChannel *channel = xfconf_channel_new ("xsettings");
-	if (channel) {
-		if (icon_theme_exists (icon_theme)) {
-			xfconf_channel_set_string (channel, "/Net/IconThemeName", icon_theme);
-		}
-		g_object_unref (channel);
+	XfconfWriter *xsettings = xfconf_writer_get ("xsettings");
+
+	if (icon_theme_exists (icon_theme)) {
+		xfconf_writer_set_string (xsettings, "/Net/IconThemeName", icon_theme);
+		xfconf_writer_commit (xsettings);
 	}
 }
 
@@ -937,131 +1084,125 @@ set_wallpaper (const char *wallpaper_name, const gchar *wallpaper_url)
 	if (!wallpaper_path) {
 		g_return_if_fail (wallpaper_url != NULL);
 
-		/* obtain filename from url */
-		gchar *filename = g_strrstr (wallpaper_url, "/") + 1;
-		if (filename) {
-			gchar *background_dir = g_build_filename (g_get_user_data_dir (), "backgrounds", NULL);
-			if (!g_file_test (background_dir, G_FILE_TEST_EXISTS)) {
-				g_mkdir_with_parents (background_dir, 0744);
-			}
-
-			/* build download path */
-			wallpaper_path = g_build_filename (background_dir, filename, NULL);
-			g_remove (wallpaper_path);
-
+		wallpaper_path = get_wallpaper_download_path (wallpaper_url);
+		if (wallpaper_path) {
 			download_with_curl (wallpaper_url, wallpaper_path);
-
-			g_free (background_dir);
 		}
 	}
 
 	g_return_if_fail (wallpaper_path != NULL);
 
 	if (g_file_test (wallpaper_path, G_FILE_TEST_EXISTS)) {
-		XfconfChannel *channel = xfconf_channel_new ("xfce4-desktop");
-		if (channel) {
-			GHashTable *table = xfconf_channel_get_properties (channel, "/backdrop");
-			if (table) {
-				GSList *sorted_contents = NULL, *l = NULL;
-
-				g_hash_table_foreach (table, (GHFunc)list_sorted, &sorted_contents);
-
-				for (l = sorted_contents; l != NULL; l = l->next) {
-					gchar *property = (gchar *)l->data;
-					if (g_str_has_suffix (property, "image-path") ||
-							g_str_has_suffix (property, "last-image") ||
-							g_str_has_suffix (property, "last-single-image")) {
-						xfconf_channel_set_string (channel, property, wallpaper_path);
-					}
-				}
-
-				g_slist_free (sorted_contents);
-				g_hash_table_destroy (table);
+		guint timing_id;
+		GList *properties, *l;
+		WallpaperVariants *variants;
+		XfconfWriter *desktop = xfconf_writer_get ("xfce4-desktop");
+
+		/* every monitor gets an image already scaled to its size */
+		timing_id = login_timing_begin ("wallpaper_variants", NULL);
+		variants = wallpaper_variants_new (wallpaper_path);
+		login_timing_end (timing_id, TRUE);
+
+		xfconf_writer_load (desktop, "/backdrop");
+		properties = xfconf_writer_list_properties (desktop, "/backdrop");
+
+		for (l = properties; l != NULL; l = l->next) {
+			const gchar *property = (const gchar *)l->data;
+			if (g_str_has_suffix (property, "image-path") ||
+					g_str_has_suffix (property, "last-image") ||
+					g_str_has_suffix (property, "last-single-image")) {
+				xfconf_writer_set_string (desktop, property,
+                                          wallpaper_variants_lookup (variants, property));
 			}
-			g_object_unref (channel);
 		}
+		g_list_free (properties);
+		wallpaper_variants_free (variants);
+
+		/* xfdesktop only hears about the monitors whose image really changes */
+		xfconf_writer_commit (desktop);
 	}
 
 	g_free (wallpaper_path);
 }
 
 static void
-handle_desktop_configuration (void)
-{
-	gchar *data = get_grm_user_data ();
-
-	if (data) {
-		enum json_tokener_error jerr = json_tokener_success;
-		json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-		if (jerr == json_tokener_success) {
-			json_object *obj1 = NULL, *obj2 = NULL, *obj3_1 = NULL, *obj3_2 = NULL, *obj3_3 = NULL;
-			obj1 = JSON_OBJECT_GET (root_obj, "data");
-			obj2 = JSON_OBJECT_GET (obj1, "desktopInfo");
-			obj3_1 = JSON_OBJECT_GET (obj2, "themeNm");
-			obj3_2 = JSON_OBJECT_GET (obj2, "wallpaperNm");
-			obj3_3 = JSON_OBJECT_GET (obj2, "wallpaperFile");
-
-			if (obj3_1) {
-				const char *icon_theme = json_object_get_string (obj3_1);
-
-				/* set icon theme */
-				set_icon_theme (icon_theme);
-			}
+handle_desktop_configuration (SessionConfig *config, SessionConfigChanges changes)
+{
+	if (config->theme && (changes & SESSION_CONFIG_CHANGED_THEME)) {
+		/* set icon theme */
+		set_icon_theme (config->theme);
+	}
+
+	if (config->wallpaper_name && config->wallpaper_url &&
+        (changes & SESSION_CONFIG_CHANGED_WALLPAPER)) {
+		/* set wallpaper */
+		set_wallpaper (config->wallpaper_name, config->wallpaper_url);
+	}
+}
 
-			if (obj3_2 && obj3_3) {
-				const char *wallpaper_name = json_object_get_string (obj3_2);
-				const char *wallpaper_url = json_object_get_string (obj3_3);
+/* fetch every favicon and the wallpaper concurrently up front so
+ * that the desktop configuration steps only have to pick them up;
+ * func is called from the main loop once they are all in */
+static void
+prefetch_remote_assets (SessionConfig      *config,
+                        SessionConfig      *old_config,
+                        DownloaderDoneFunc  func,
+                        gpointer            data)
+{
+	guint i;
+	SessionConfigChanges changes = session_config_diff (old_config, config);
 
-				/* set wallpaper */
-				set_wallpaper (wallpaper_name, wallpaper_url);
-			}
+	if (config->wallpaper_name && config->wallpaper_url &&
+        (changes & SESSION_CONFIG_CHANGED_WALLPAPER)) {
+		gchar *wallpaper_path = find_wallpaper (config->wallpaper_name);
 
-			json_object_put (root_obj);
+		if (!wallpaper_path) {
+			wallpaper_path = get_wallpaper_download_path (config->wallpaper_url);
+			if (wallpaper_path)
+				downloader_add (asset_downloader, config->wallpaper_url, wallpaper_path);
 		}
+		g_free (wallpaper_path);
 	}
 
-	g_free (data);
-}
+	/* favicons are only used for the user's own launchers */
+	if (is_session_owner (config)) {
+		for (i = 0; i < config->apps->len; i++) {
+			SessionApp *app = g_ptr_array_index (config->apps, i);
 
-static void
-reload_grac_service_done_cb (GObject *source, GAsyncResult *res, gpointer data)
-{
-	GDBusProxy *proxy = G_DBUS_PROXY (source);
+			/* with an old config, only the launchers that changed */
+			if (old_config &&
+                !(changes & SESSION_CONFIG_CHANGED_USER) &&
+                session_app_equal (app, session_config_find_app (old_config, app->index)))
+				continue;
+
+			if (session_app_has_remote_icon (app)) {
+				gchar *favicon_path = get_favicon_path (app->index);
+				downloader_add (asset_downloader, app->icon, favicon_path);
+				g_free (favicon_path);
+			}
+		}
+	}
 
-	g_dbus_proxy_call_finish (proxy, res, NULL);
+	downloader_run_async (asset_downloader, func, data);
 }
 
 static void
-reload_grac_service (void)
+grac_reload_finish (GracReload *reload, gboolean success, GError *error)
 {
-	if (!authenticate ("kr.gooroom.autostart.program.systemctl"))
-		return;
-
-	GDBusProxy  *proxy = NULL;
-	gboolean     success = FALSE;
-	const gchar *service_name = "grac-device-daemon.service";
+	if (!success) {
+		g_warning ("Failed to reload %s: %s", GRAC_SERVICE_NAME,
+                   error ? error->message : "not authorized");
+	}
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE,
-			NULL,
-			"org.freedesktop.systemd1",
-			"/org/freedesktop/systemd1",
-			"org.freedesktop.systemd1.Manager",
-			NULL, NULL);
+	login_timing_end (reload->timing_id, success);
+	task_graph_job_done (reload->job, success);
 
-	if (proxy) {
-		GVariant *variant = NULL;
-		variant = g_dbus_proxy_call_sync (proxy, "ReloadUnit",
-				g_variant_new ("(ss)", service_name, "replace"),
-				G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
-
-		if (variant) {
-			g_variant_unref (variant);
-			success = TRUE;
-		}
+	g_clear_object (&reload->permission);
+	g_object_unref (reload->cancellable);
+	g_free (reload);
 
-		g_object_unref (proxy);
-	}
+	if (error)
+		g_error_free (error);
 
 #if 0
 	if (!success) {
@@ -1082,56 +1223,196 @@ reload_grac_service (void)
 }
 
 static void
-request_dpms_off_time_done_cb (GObject      *source_object,
-                               GAsyncResult *res,
-                               gpointer      user_data)
+reload_grac_service_done_cb (GObject *source, GAsyncResult *res, gpointer data)
 {
-	GVariant *variant;
-	gchar *data = NULL;
-	XfconfChannel *channel;
-
-	channel = XFCONF_CHANNEL (user_data);
+	GError *error = NULL;
+	GVariant *variant = NULL;
+	GracReload *reload = (GracReload *)data;
 
-	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, NULL);
-	if (variant) {
-		GVariant *v;
-		g_variant_get (variant, "(v)", &v);
-		if (v) {
-			data = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
+	variant = systemd_client_call_finish (systemd_client_get_default (), res, &error);
+	if (variant)
 		g_variant_unref (variant);
+
+	grac_reload_finish (reload, (variant != NULL), error);
+}
+
+static void
+grac_reload_authorized (GracReload *reload)
+{
+	systemd_client_call (systemd_client_get_default (),
+                         "ReloadUnit",
+                         g_variant_new ("(ss)", GRAC_SERVICE_NAME, "replace"),
+                         GRAC_RELOAD_CALL_TIMEOUT,
+                         reload->cancellable,
+                         reload_grac_service_done_cb,
+                         reload);
+}
+
+static void
+grac_permission_acquire_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GError *error = NULL;
+	GracReload *reload = (GracReload *)data;
+
+	if (!g_permission_acquire_finish (G_PERMISSION (source), res, &error)) {
+		grac_reload_finish (reload, FALSE, error);
+		return;
 	}
 
-	if (data) {
-		gchar *value = get_dpms_off_time_from_json (data);
-		dpms_off_time_update (atoi (value), channel);
-		g_free (value);
-		g_free (data);
+	grac_reload_authorized (reload);
+}
+
+static void
+grac_permission_new_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GError *error = NULL;
+	GracReload *reload = (GracReload *)data;
+
+	reload->permission = polkit_permission_new_finish (res, &error);
+	if (!reload->permission) {
+		grac_reload_finish (reload, FALSE, error);
+		return;
+	}
+
+	if (g_permission_get_allowed (reload->permission)) {
+		grac_reload_authorized (reload);
+	} else {
+		g_permission_acquire_async (reload->permission,
+                                    reload->cancellable,
+                                    grac_permission_acquire_cb,
+                                    reload);
 	}
 }
 
+/* polkit check and ReloadUnit run in the background; when the job's
+ * deadline passes the pending step completes with G_IO_ERROR_CANCELLED */
 static void
-dpms_off_time_set (gpointer data)
+reload_grac_service (TaskGraphJob *job, gpointer data)
 {
-	agent_proxy = agent_proxy_get ();
-	if (agent_proxy) {
-		const gchar *json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"dpms_off_time\",\"in\":{\"login_id\":\"%s\"}}}}";
+	GracReload *reload;
+
+	if (replay_trace_is_active ()) {
+		replay_trace_record ("dbus", "org.freedesktop.systemd1.Manager.ReloadUnit", GRAC_SERVICE_NAME);
+		task_graph_job_done (job, TRUE);
+		return;
+	}
 
-		gchar *arg = g_strdup_printf (json, g_get_user_name ());
+	reload = g_new0 (GracReload, 1);
+	reload->job = job;
+	reload->cancellable = g_object_ref (task_graph_job_get_cancellable (job));
+	reload->timing_id = login_timing_begin ("reload_grac_service", NULL);
 
-		g_dbus_proxy_call (agent_proxy,
-                           "do_task",
-                           g_variant_new ("(s)", arg),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
+	polkit_permission_new ("kr.gooroom.autostart.program.systemctl",
                            NULL,
-                           request_dpms_off_time_done_cb,
-                           data);
-		g_free (arg);
+                           reload->cancellable,
+                           grac_permission_new_cb,
+                           reload);
+}
+
+static void
+agent_signal_apply_dpms (GVariant *parameters, gpointer data)
+{
+	gint32 value = 0;
+
+	g_variant_get (parameters, "(i)", &value);
+	dpms_off_time_update (value, (XfconfWriter *)data);
+}
+
+static void
+agent_signal_apply_update_operation (GVariant *parameters, gpointer data)
+{
+	gint32 value = -1;
+	g_variant_get (parameters, "(i)", &value);
+
+	NotifyNotification *notification;
+	gchar *cmdline = NULL;
+	const gchar *message;
+	const gchar *icon = "software-update-available-symbolic";
+	const gchar *summary = _("Update Blocking Function");
+	if (value == 0) {
+		message = _("Update blocking function has been disabled.");
+		cmdline = g_find_program_in_path ("gooroom-update-launcher");
+	} else if (value == 1) {
+		message = _("Update blocking function has been enabled.");
+		gchar *cmd = g_find_program_in_path ("pkill");
+		if (cmd) cmdline = g_strdup_printf ("%s -f '/usr/lib/gooroom/gooroomUpdate/gooroomUpdate.py'", cmd);
+		g_free (cmd);
+	}
+
+	g_spawn_command_line_async (cmdline, NULL);
+	g_free (cmdline);
+
+	notify_init (PACKAGE_NAME);
+	notification = notify_notification_new (summary, message, icon);
+
+	notify_notification_set_urgency (notification, NOTIFY_URGENCY_NORMAL);
+	notify_notification_set_timeout (notification, NOTIFY_EXPIRES_DEFAULT);
+	notify_notification_show (notification, NULL);
+	g_object_unref (notification);
+}
+
+static void
+agent_signal_apply_blacklist (GVariant *parameters, gpointer data)
+{
+	GVariant *v = NULL;
+	gchar *blacklist = NULL;
+	g_variant_get (parameters, "(v)", &v);
+	if (v) {
+		blacklist = g_variant_dup_string (v, NULL);
+		g_variant_unref (v);
+	}
+
+	if (blacklist) {
+		save_application_blacklist (blacklist);
+		g_free (blacklist);
 	}
 }
 
+/*
+ * Policies are often pushed several times in a row. Each signal type
+ * waits for AGENT_SIGNAL_QUIET_TIME without a new signal, then applies
+ * the latest parameters once. Nothing is remembered past the window: a
+ * later push of the same policy is applied again, since the local value
+ * may have been changed in between; the writers skip what is unchanged.
+ */
+typedef struct {
+	const gchar  *name;
+	const gchar  *type;
+	void        (*apply) (GVariant *parameters, gpointer data);
+	GVariant     *pending;
+	gpointer      data;
+	guint         timeout_id;
+} AgentSignalQueue;
+
+static AgentSignalQueue agent_signal_queues[] = {
+	{ "dpms_on_x_off",    "(i)", agent_signal_apply_dpms },
+	{ "update_operation", "(i)", agent_signal_apply_update_operation },
+	{ "app_black_list",   "(v)", agent_signal_apply_blacklist }
+};
+
+static gboolean
+agent_signal_quiet_cb (gpointer data)
+{
+	AgentSignalQueue *queue = (AgentSignalQueue *)data;
+	GVariant *parameters;
+	gchar *counter;
+
+	queue->timeout_id = 0;
+
+	parameters = queue->pending;
+	queue->pending = NULL;
+
+	queue->apply (parameters, queue->data);
+
+	counter = g_strdup_printf ("signals.%s.applied", queue->name);
+	metrics_count (counter, 1);
+	g_free (counter);
+
+	g_variant_unref (parameters);
+
+	return FALSE;
+}
+
 static void
 agent_signal_cb (GDBusProxy *proxy,
                  gchar *sender_name,
@@ -1141,116 +1422,128 @@ agent_signal_cb (GDBusProxy *proxy,
 {
 	g_return_if_fail (user_data != NULL);
 
-	XfconfChannel *channel = XFCONF_CHANNEL (user_data);
-
-	if (g_str_equal (signal_name, "dpms_on_x_off")) {
-		gint32 value = 0;
-		g_variant_get (parameters, "(i)", &value);
-		dpms_off_time_update (value, channel);
-	} else if (g_str_equal (signal_name, "update_operation")) {
-		gint32 value = -1;
-		g_variant_get (parameters, "(i)", &value);
-
-		NotifyNotification *notification;
-		gchar *cmdline = NULL;
-		const gchar *message;
-		const gchar *icon = "software-update-available-symbolic";
-		const gchar *summary = _("Update Blocking Function");
-		if (value == 0) {
-			message = _("Update blocking function has been disabled.");
-			cmdline = g_find_program_in_path ("gooroom-update-launcher");
-		} else if (value == 1) {
-			message = _("Update blocking function has been enabled.");
-			gchar *cmd = g_find_program_in_path ("pkill");
-			if (cmd) cmdline = g_strdup_printf ("%s -f '/usr/lib/gooroom/gooroomUpdate/gooroomUpdate.py'", cmd);
-			g_free (cmd);
-		}
+	guint i;
+	gchar *counter;
 
-		g_spawn_command_line_async (cmdline, NULL);
-		g_free (cmdline);
+	for (i = 0; i < G_N_ELEMENTS (agent_signal_queues); i++) {
+		AgentSignalQueue *queue = &agent_signal_queues[i];
 
-		notify_init (PACKAGE_NAME);
-		notification = notify_notification_new (summary, message, icon);
-
-		notify_notification_set_urgency (notification, NOTIFY_URGENCY_NORMAL);
-		notify_notification_set_timeout (notification, NOTIFY_EXPIRES_DEFAULT);
-		notify_notification_show (notification, NULL);
-		g_object_unref (notification);
-	} else if (g_str_equal (signal_name, "app_black_list")) {
-		GVariant *v = NULL;
-		gchar *blacklist = NULL;
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			blacklist = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
+		if (!g_str_equal (signal_name, queue->name))
+			continue;
 
-		if (blacklist) {
-			save_application_blacklist (blacklist);
-			g_free (blacklist);
-		}
+		if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE (queue->type)))
+			return;
+
+		counter = g_strdup_printf ("signals.%s", queue->name);
+		metrics_count (counter, 1);
+		g_free (counter);
+
+		/* only the last signal of a burst counts */
+		if (queue->pending)
+			g_variant_unref (queue->pending);
+		queue->pending = g_variant_ref (parameters);
+		queue->data = user_data;
+
+		if (queue->timeout_id)
+			g_source_remove (queue->timeout_id);
+		queue->timeout_id = g_timeout_add (AGENT_SIGNAL_QUIET_TIME, agent_signal_quiet_cb, queue);
+
+		return;
 	}
 }
 
 static void
-gooroom_agent_bind_signal (gpointer data)
+agent_signal_bind_cb (GDBusProxy *proxy, gpointer data)
 {
-	agent_proxy = agent_proxy_get ();
-	if (agent_proxy) {
-		g_signal_connect (agent_proxy, "g-signal", G_CALLBACK (agent_signal_cb), data);
+	TaskGraphJob *job = (TaskGraphJob *)data;
+
+	if (proxy) {
+		g_signal_connect (proxy, "g-signal", G_CALLBACK (agent_signal_cb),
+                          task_graph_job_get_data (job));
 	}
+
+	task_graph_job_done (job, (proxy != NULL));
 }
 
 static void
-request_app_blacklist_done_cb (GObject      *source_object,
-                               GAsyncResult *res,
-                               gpointer      user_data)
+gooroom_agent_bind_signal (TaskGraphJob *job, gpointer data)
 {
-	GVariant *variant;
-	gchar *data = NULL;
+	agent_client_when_ready (agent_client_get_default (), agent_signal_bind_cb, job);
+}
 
-	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, NULL);
-	if (variant) {
-		GVariant *v;
-		g_variant_get (variant, "(v)", &v);
-		if (v) {
-			data = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
-		g_variant_unref (variant);
-	}
+static void
+dpms_off_time_apply (const gchar *reply, XfconfWriter *power)
+{
+	gchar *value = get_dpms_off_time_from_json (reply);
 
-	if (data) {
-		gchar *blacklist = get_blacklist_from_json (data);
-		if (blacklist) {
-			save_application_blacklist (blacklist);
-			g_free (blacklist);
-		}
-		g_free (data);
+	if (value) {
+		dpms_off_time_update (atoi (value), power);
+		g_free (value);
 	}
 }
 
 static void
-application_blacklist_update ()
+application_blacklist_apply (const gchar *reply)
 {
-	agent_proxy = agent_proxy_get ();
-	if (agent_proxy) {
-		const gchar *json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"get_app_list\",\"in\":{\"login_id\":\"%s\"}}}}";
-
-		gchar *arg = g_strdup_printf (json, g_get_user_name ());
+	gchar *blacklist = get_blacklist_from_json (reply);
 
-		g_dbus_proxy_call (agent_proxy,
-                           "do_task",
-                           g_variant_new ("(s)", arg),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           request_app_blacklist_done_cb,
-                           NULL);
-		g_free (arg);
+	if (blacklist) {
+		save_application_blacklist (blacklist);
+		g_free (blacklist);
 	}
 }
 
+typedef struct {
+	TaskGraphJob  *job;
+	XfconfWriter  *power;
+	guint          dpms_task;
+	guint          dpms_timing_id;
+	guint          blacklist_task;
+	guint          blacklist_timing_id;
+} AgentSettingsRequest;
+
+static void
+agent_settings_done_cb (AgentBatch *batch, gpointer data)
+{
+	const gchar *reply;
+	gboolean success = TRUE;
+	AgentSettingsRequest *request = (AgentSettingsRequest *)data;
+
+	reply = agent_batch_get_reply (batch, request->dpms_task);
+	if (reply)
+		dpms_off_time_apply (reply, request->power);
+	login_timing_end (request->dpms_timing_id, (reply != NULL));
+	success &= (reply != NULL);
+
+	reply = agent_batch_get_reply (batch, request->blacklist_task);
+	if (reply)
+		application_blacklist_apply (reply);
+	login_timing_end (request->blacklist_timing_id, (reply != NULL));
+	success &= (reply != NULL);
+
+	task_graph_job_done (request->job, success);
+	g_free (request);
+}
+
+/* dpms_off_time and get_app_list go out together and are handled as one */
+static void
+agent_settings_update (TaskGraphJob *job, gpointer data)
+{
+	AgentBatch *batch;
+	AgentSettingsRequest *request;
+
+	request = g_new0 (AgentSettingsRequest, 1);
+	request->job = job;
+	request->power = (XfconfWriter *)data;
+	request->dpms_timing_id = login_timing_begin ("dpms_off_time_set", NULL);
+	request->blacklist_timing_id = login_timing_begin ("application_blacklist_update", NULL);
+
+	batch = agent_batch_new (agent_client_get_default ());
+	request->dpms_task = agent_batch_add (batch, "config", "dpms_off_time");
+	request->blacklist_task = agent_batch_add (batch, "config", "get_app_list");
+	agent_batch_run (batch, agent_settings_done_cb, request);
+}
+
 static gboolean
 logout_session_cb (gpointer data)
 {
@@ -1278,89 +1571,563 @@ logout_session_cb (gpointer data)
 }
 
 static void
-start_job_on_online (gpointer data)
+session_config_missing (gpointer data)
 {
-	gchar *file = g_strdup_printf ("/var/run/user/%d/gooroom/%s", getuid (), GRM_USER);
+	GtkWidget *message = gtk_message_dialog_new (NULL,
+			GTK_DIALOG_MODAL,
+			GTK_MESSAGE_ERROR,
+			GTK_BUTTONS_OK,
+			NULL);
 
-	if (g_file_test (file, G_FILE_TEST_EXISTS)) {
-		/* configure desktop */
-		handle_desktop_configuration ();
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (message),
+			_("Could not found user's settings file.\nAfter 10 seconds, the user will be logged out."));
 
-		/* handle the Direct URL items */
-		dock_launcher_update ();
-	} else {
-		GtkWidget *message = gtk_message_dialog_new (NULL,
-				GTK_DIALOG_MODAL,
-				GTK_MESSAGE_ERROR,
-				GTK_BUTTONS_OK,
-				NULL);
+	gtk_window_set_title (GTK_WINDOW (message), _("Terminating Session"));
+
+	g_signal_connect (message, "response", G_CALLBACK (gtk_widget_destroy), NULL);
+
+	g_timeout_add (1000 * 10, (GSourceFunc) logout_session_cb, data);
+
+	gtk_widget_show (message);
+}
+
+static gchar *
+get_session_config_path (void)
+{
+	if (config_file)
+		return g_strdup (config_file);
+
+	return session_config_get_path ();
+}
+
+/* .grm-user is parsed once and shared by the jobs depending on this one;
+ * they are skipped when it fails */
+static void
+session_config_job (TaskGraphJob *job, gpointer data)
+{
+	gchar *file;
+	guint timing_id;
+	GError *error = NULL;
+
+	/* shortcuts of online users are reconciled with their settings */
+	if (!is_online_user (g_get_user_name ())) {
+		remove_custom_desktop_files ();
+		task_graph_job_done (job, FALSE);
+		return;
+	}
+
+	file = get_session_config_path ();
+
+	if (!g_file_test (file, G_FILE_TEST_EXISTS)) {
+		remove_custom_desktop_files ();
+		if (replay_trace_is_active ())
+			g_warning ("%s does not exist", file);
+		else
+			session_config_missing (data);
+		g_free (file);
+		task_graph_job_done (job, FALSE);
+		return;
+	}
+
+	timing_id = login_timing_begin ("session_config_load", NULL);
+	session_config = session_config_load (file, &error);
+	login_timing_end (timing_id, (session_config != NULL));
+
+	if (!session_config) {
+		g_warning ("Failed to load user's settings: %s", error->message);
+		g_error_free (error);
+		remove_custom_desktop_files ();
+	}
+
+	g_free (file);
+
+	task_graph_job_done (job, (session_config != NULL));
+}
+
+static void
+remote_assets_done_cb (Downloader *downloader, gpointer data)
+{
+	task_graph_job_done ((TaskGraphJob *)data, TRUE);
+}
+
+/* download favicons and wallpaper while the other jobs go on */
+static void
+remote_assets_job (TaskGraphJob *job, gpointer data)
+{
+	asset_cache = asset_cache_new ();
+	asset_downloader = asset_downloader_new ();
+	downloader_set_cache (asset_downloader, asset_cache);
+
+	prefetch_remote_assets (session_config, NULL, remote_assets_done_cb, job);
+}
+
+/* configure desktop */
+static void
+desktop_configuration_job (TaskGraphJob *job, gpointer data)
+{
+	guint timing_id;
+
+	timing_id = login_timing_begin ("handle_desktop_configuration", NULL);
+	handle_desktop_configuration (session_config, SESSION_CONFIG_CHANGED_ALL);
+	login_timing_end (timing_id, TRUE);
+
+	task_graph_job_done (job, TRUE);
+}
+
+/* handle the Direct URL items */
+static void
+dock_launchers_job (TaskGraphJob *job, gpointer data)
+{
+	guint timing_id;
+
+	timing_id = login_timing_begin ("dock_launcher_update", NULL);
+	dock_launcher_update (session_config);
+	login_timing_end (timing_id, TRUE);
+
+	task_graph_job_done (job, TRUE);
+}
+
+static void
+bus_name_gate_finish (BusNameGate *gate, gboolean appeared)
+{
+	g_bus_unwatch_name (gate->watch_id);
+
+	if (gate->timeout_id)
+		g_source_remove (gate->timeout_id);
+
+	login_timing_end (gate->timing_id, appeared);
+
+	/* dependents run either way; they did so before there was a gate */
+	task_graph_job_done (gate->job, TRUE);
+
+	g_free (gate);
+}
+
+static void
+bus_name_appeared_cb (GDBusConnection *connection,
+                      const gchar     *name,
+                      const gchar     *name_owner,
+                      gpointer         data)
+{
+	bus_name_gate_finish ((BusNameGate *)data, TRUE);
+}
+
+static gboolean
+bus_name_gate_timeout_cb (gpointer data)
+{
+	BusNameGate *gate = (BusNameGate *)data;
+	const BusName *bus_name = task_graph_job_get_data (gate->job);
+
+	g_warning ("%s did not appear within %d seconds", bus_name->name, BUS_NAME_GATE_TIMEOUT);
+
+	gate->timeout_id = 0;
+	bus_name_gate_finish (gate, FALSE);
+
+	return FALSE;
+}
+
+/* finishes as soon as the BusName in data has an owner */
+static void
+bus_name_gate_job (TaskGraphJob *job, gpointer data)
+{
+	BusNameGate *gate;
+	const BusName *bus_name = (const BusName *)data;
+
+	/* a replay has no services to wait for */
+	if (replay_trace_is_active ()) {
+		task_graph_job_done (job, TRUE);
+		return;
+	}
+
+	gate = g_new0 (BusNameGate, 1);
+	gate->job = job;
+	gate->timing_id = login_timing_begin ("wait_bus_name", bus_name->name);
+	gate->timeout_id = g_timeout_add_seconds (BUS_NAME_GATE_TIMEOUT,
+                                              bus_name_gate_timeout_cb, gate);
+	gate->watch_id = g_bus_watch_name (bus_name->bus_type,
+                                       bus_name->name,
+                                       bus_name->flags,
+                                       bus_name_appeared_cb,
+                                       NULL,
+                                       gate,
+                                       NULL);
+}
+
+static void session_config_reapply (void);
+
+static void
+session_config_reapply_free (SessionConfigReapply *reapply)
+{
+	downloader_free (asset_downloader);
+	asset_downloader = NULL;
+
+	asset_cache_free (asset_cache);
+	asset_cache = NULL;
+
+	session_config_free (reapply->config);
+	g_free (reapply);
+}
+
+static void
+session_config_reapply_done_cb (Downloader *downloader, gpointer data)
+{
+	gboolean reload_again;
+	SessionConfigReapply *reapply = session_config_reapplying;
 
-		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (message),
-				_("Could not found user's settings file.\nAfter 10 seconds, the user will be logged out."));
+	session_config_reapplying = NULL;
 
-		gtk_window_set_title (GTK_WINDOW (message), _("Terminating Session"));
+	handle_desktop_configuration (reapply->config, reapply->changes);
 
-		g_signal_connect (message, "response", G_CALLBACK (gtk_widget_destroy), NULL);
+	/* unchanged launchers keep their desktop files, icons and GConf entries */
+	if (reapply->changes & (SESSION_CONFIG_CHANGED_USER | SESSION_CONFIG_CHANGED_APPS))
+		dock_launcher_update (reapply->config);
 
-		g_timeout_add (1000 * 10, (GSourceFunc) logout_session_cb, data);
+	session_config_free (applied_config);
+	applied_config = reapply->config;
+	reapply->config = NULL;
 
-		gtk_widget_show (message);
+	reload_again = reapply->reload_again;
+	session_config_reapply_free (reapply);
+
+	if (reload_again)
+		session_config_reapply ();
+}
+
+/* re-runs only the steps the new .grm-user changes */
+static void
+session_config_reapply (void)
+{
+	gchar *file;
+	GError *error = NULL;
+	SessionConfig *config;
+	SessionConfigChanges changes;
+
+	/* one at a time, the downloads of the running one are still in flight */
+	if (session_config_reapplying) {
+		session_config_reapplying->reload_again = TRUE;
+		return;
 	}
 
+	file = get_session_config_path ();
+	config = session_config_load (file, &error);
 	g_free (file);
+
+	if (!config) {
+		/* a half-written file is read again on its next change */
+		g_warning ("Failed to reload user's settings: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	changes = session_config_diff (applied_config, config);
+	if (changes == SESSION_CONFIG_CHANGED_NONE) {
+		session_config_free (config);
+		return;
+	}
+
+	session_config_reapplying = g_new0 (SessionConfigReapply, 1);
+	session_config_reapplying->config = config;
+	session_config_reapplying->changes = changes;
+
+	asset_cache = asset_cache_new ();
+	asset_downloader = asset_downloader_new ();
+	downloader_set_cache (asset_downloader, asset_cache);
+
+	prefetch_remote_assets (config, applied_config, session_config_reapply_done_cb, NULL);
+}
+
+static gboolean
+session_config_reload_cb (gpointer data)
+{
+	session_config_reload_id = 0;
+
+	session_config_reapply ();
+
+	return FALSE;
+}
+
+static void
+session_config_changed_cb (GFileMonitor      *monitor,
+                           GFile             *file,
+                           GFile             *other_file,
+                           GFileMonitorEvent  event_type,
+                           gpointer           data)
+{
+	switch (event_type) {
+		case G_FILE_MONITOR_EVENT_CHANGED:
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_CREATED:
+			/* one reload once the writer has gone quiet */
+			if (session_config_reload_id)
+				g_source_remove (session_config_reload_id);
+			session_config_reload_id = g_timeout_add (SESSION_CONFIG_RELOAD_DELAY,
+                                                      session_config_reload_cb, NULL);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+session_config_watch (void)
+{
+	gchar *path;
+	GFile *file;
+	GError *error = NULL;
+
+	path = get_session_config_path ();
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	session_config_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
+	if (session_config_monitor) {
+		g_signal_connect (session_config_monitor, "changed",
+                          G_CALLBACK (session_config_changed_cb), NULL);
+	} else {
+		g_warning ("Could not watch user's settings: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_object_unref (file);
+}
+
+static void
+login_jobs_done_cb (TaskGraph *graph, gpointer data)
+{
+	guint failed;
+
+	login_graph = NULL;
+
+	failed = task_graph_get_failed (graph);
+	if (failed > 0) {
+		g_warning ("%u login jobs failed or were skipped", failed);
+		metrics_count ("login.jobs_failed", failed);
+	}
+
+	downloader_free (asset_downloader);
+	asset_downloader = NULL;
+
+	asset_cache_free (asset_cache);
+	asset_cache = NULL;
+
+	if (resident && !replay_trace_is_active () && is_online_user (g_get_user_name ())) {
+		/* later versions of .grm-user are compared against this one */
+		applied_config = session_config;
+		session_config_watch ();
+	} else {
+		session_config_free (session_config);
+	}
+	session_config = NULL;
+
+	/* the record is written once the last phase has ended */
+	login_timing_finish ();
+
+	/* a replay is over once its jobs are */
+	if (replay_trace_is_active () && gtk_main_level () > 0)
+		gtk_main_quit ();
 }
 
 static gboolean
 start_job (gpointer data)
 {
-	remove_custom_desktop_files ();
+	TaskGraph *graph;
+	TaskGraphJob *xfconf_ready, *panel_ready, *agent_ready;
+	TaskGraphJob *config_job, *assets_job, *job;
+
+	login_timing_start ();
+
+	graph = task_graph_new ();
+	login_graph = graph;
+
+	/* each phase waits for the service it talks to rather than a fixed delay */
+	xfconf_ready = task_graph_add (graph, "wait_xfconf", bus_name_gate_job, (gpointer) &xfconf_bus_name, 0);
+	panel_ready = task_graph_add (graph, "wait_panel", bus_name_gate_job, (gpointer) &panel_bus_name, 0);
+	agent_ready = task_graph_add (graph, "wait_agent", bus_name_gate_job, (gpointer) &agent_bus_name, 0);
 
-	if (is_online_user (g_get_user_name ())) {
-		start_job_on_online (data);
+	/* jobs that wait on other processes go first, so they are in
+	 * flight while the desktop is being set up */
+	task_graph_add (graph, "reload_grac_service", reload_grac_service, NULL, GRAC_RELOAD_TIMEOUT);
+
+	/* the agent's policies are input a replay does not have */
+	if (!replay_trace_is_active ()) {
+		job = task_graph_add (graph, "agent_settings", agent_settings_update, data, AGENT_SETTINGS_TIMEOUT);
+		task_graph_job_depends_on (job, agent_ready);
+		task_graph_job_depends_on (job, xfconf_ready);
+
+		job = task_graph_add (graph, "agent_signals", gooroom_agent_bind_signal, data, AGENT_SETTINGS_TIMEOUT);
+		task_graph_job_depends_on (job, agent_ready);
 	}
 
-	/* reload grac service */
-	reload_grac_service ();
+	config_job = task_graph_add (graph, "session_config", session_config_job, data, 0);
+
+	assets_job = task_graph_add (graph, "remote_assets", remote_assets_job, NULL, 0);
+	task_graph_job_depends_on (assets_job, config_job);
 
-	dpms_off_time_set (data);
+	job = task_graph_add (graph, "desktop_configuration", desktop_configuration_job, NULL, 0);
+	task_graph_job_depends_on (job, assets_job);
+	task_graph_job_depends_on (job, xfconf_ready);
 
-	application_blacklist_update ();
+	job = task_graph_add (graph, "dock_launchers", dock_launchers_job, NULL, 0);
+	task_graph_job_depends_on (job, assets_job);
+	task_graph_job_depends_on (job, panel_ready);
+
+	task_graph_run (graph, login_jobs_done_cb, NULL);
+
+	return FALSE;
+}
 
-	gooroom_agent_bind_signal (data);
+/* the session is ending */
+static gboolean
+quit_signal_cb (gpointer data)
+{
+	gtk_main_quit ();
 
 	return FALSE;
 }
 
+/* points the XDG directories and $HOME at replay_root, which is
+ * created when not given, and opens the trace */
+static gboolean
+replay_setup (GError **error)
+{
+	guint i;
+	const gchar *dirs[][2] = {
+		{ "XDG_CONFIG_HOME", ".config" },
+		{ "XDG_CACHE_HOME",  ".cache" },
+		{ "XDG_DATA_HOME",   ".local/share" },
+		{ "XDG_RUNTIME_DIR", "run" }
+	};
+
+	if (!replay_root) {
+		replay_root = g_dir_make_tmp ("gooroom-replay-XXXXXX", error);
+		if (!replay_root)
+			return FALSE;
+	}
+
+	g_setenv ("HOME", replay_root, TRUE);
+
+	for (i = 0; i < G_N_ELEMENTS (dirs); i++) {
+		gchar *dir = g_build_filename (replay_root, dirs[i][1], NULL);
+		g_mkdir_with_parents (dir, 0700);
+		g_setenv (dirs[i][0], dir, TRUE);
+		g_free (dir);
+	}
+
+	return replay_trace_open (replay_trace_file, error);
+}
+
 int
 main (int argc, char **argv)
 {
 	GError *error = NULL;
-	XfconfChannel *channel = NULL;
+	GOptionContext *context;
+	XfconfWriter *power = NULL;
+
+	GOptionEntry entries[] = {
+		{ "resident", 'r', 0, G_OPTION_ARG_NONE, &resident,
+		  N_("Apply changes of the user's settings while the session runs"), NULL },
+		{ "trace", 0, 0, G_OPTION_ARG_FILENAME, &replay_trace_file,
+		  N_("Replay offline and record side effects to FILE instead of applying them"), N_("FILE") },
+		{ "config", 0, 0, G_OPTION_ARG_FILENAME, &config_file,
+		  N_("Read the user's settings from FILE"), N_("FILE") },
+		{ "assets", 0, 0, G_OPTION_ARG_FILENAME, &replay_assets,
+		  N_("Directory to take the replay's favicons and wallpapers from"), N_("DIR") },
+		{ "root", 0, 0, G_OPTION_ARG_FILENAME, &replay_root,
+		  N_("Home and XDG directories of the replay"), N_("DIR") },
+		{ NULL }
+	};
 
 	bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 	textdomain (GETTEXT_PACKAGE);
 
-	gtk_init (&argc, &argv);
+	/* GTK is initialized after the options: GLib and GTK read
+	 * the XDG directories a replay changes only once */
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (replay_trace_file) {
+		if (!replay_setup (&error)) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			return 1;
+		}
+	} else if (replay_assets || replay_root) {
+		g_printerr ("--assets and --root only apply with --trace\n");
+		return 1;
+	}
+
+	/* a replay needs no display, e.g. on a build machine */
+	if (!gtk_init_check (&argc, &argv) && !replay_trace_is_active ()) {
+		g_printerr ("Failed to initialize GTK\n");
+		return 1;
+	}
 
-	if (!xfconf_init (&error)) {
+	/* neither does it have an xfconfd; the writers use the fixture's channel files */
+	if (!replay_trace_is_active () && !xfconf_init (&error)) {
 		g_error ("Failed to connect to xfconf daemon: %s.", error->message);
 		g_error_free (error);
 	}
 
-	channel = xfconf_channel_new ("xfce4-power-manager");
+	/* counters and histograms for monitoring, see metrics.c */
+	if (!replay_trace_is_active ())
+		metrics_export ();
 
-	g_timeout_add (200, (GSourceFunc) start_job, channel);
+	power = xfconf_writer_get ("xfce4-power-manager");
+
+	g_idle_add ((GSourceFunc) start_job, power);
+
+	g_unix_signal_add (SIGTERM, quit_signal_cb, NULL);
+	g_unix_signal_add (SIGINT, quit_signal_cb, NULL);
 
 	gtk_main ();
 
-	if (agent_proxy)
-		g_object_unref (agent_proxy);
+	/* the login was cut short; its jobs still in flight are cancelled */
+	if (login_graph)
+		task_graph_cancel (login_graph);
+
+	if (session_config_reload_id)
+		g_source_remove (session_config_reload_id);
+	if (session_config_reapplying)
+		session_config_reapply_free (session_config_reapplying);
+	g_clear_object (&session_config_monitor);
+	session_config_free (applied_config);
+	if (fetched_favicons)
+		g_hash_table_destroy (fetched_favicons);
+
+	if (applauncher_settings) {
+		g_settings_sync ();
+		g_object_unref (applauncher_settings);
+	}
+
+	agent_client_free (agent_client_get_default ());
+
+	systemd_client_free_default ();
+
+	xfconf_writer_shutdown ();
+
+	if (replay_trace_is_active ()) {
+		g_message ("Replay of %s finished", replay_root);
+		replay_trace_close ();
+	} else {
+		xfconf_shutdown ();
+	}
 
-	if (channel)
-		g_object_unref (channel);
+	metrics_shutdown ();
 
-	xfconf_shutdown ();
+	g_free (replay_trace_file);
+	g_free (config_file);
+	g_free (replay_assets);
+	g_free (replay_root);
 
 	return 0;
 }
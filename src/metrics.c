@@ -0,0 +1,286 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "metrics.h"
+
+#define	METRICS_BUS_NAME		"kr.gooroom.AutostartProgram"
+#define	METRICS_OBJECT_PATH		"/kr/gooroom/AutostartProgram/Metrics"
+#define	METRICS_INTERFACE		"kr.gooroom.AutostartProgram.Metrics"
+
+
+/*
+ * Counters and latency histograms for the lifetime of the process,
+ * readable on the session bus so that monitoring can scrape them:
+ *
+ *   gdbus call --session --dest kr.gooroom.AutostartProgram \
+ *     --object-path /kr/gooroom/AutostartProgram/Metrics \
+ *     --method kr.gooroom.AutostartProgram.Metrics.GetHistograms
+ *
+ * GetCounters () returns name -> value. GetHistograms () returns
+ * name -> (count, sum in ms, buckets), where buckets[i] counts the
+ * observations up to BucketBounds[i] ms and the last one the rest.
+ * Both are collected from the start, whether exported or not.
+ */
+static const gdouble bucket_bounds[] = {
+	1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+
+typedef struct {
+	guint64  count;
+	gdouble  sum;
+	guint64  buckets[G_N_ELEMENTS (bucket_bounds) + 1];
+} Histogram;
+
+
+static const gchar metrics_xml[] =
+	"<node>"
+	"  <interface name='" METRICS_INTERFACE "'>"
+	"    <method name='GetCounters'>"
+	"      <arg name='counters' type='a{st}' direction='out'/>"
+	"    </method>"
+	"    <method name='GetHistograms'>"
+	"      <arg name='histograms' type='a{s(tdat)}' direction='out'/>"
+	"    </method>"
+	"    <property name='BucketBounds' type='ad' access='read'/>"
+	"    <property name='StartTime' type='x' access='read'/>"
+	"  </interface>"
+	"</node>";
+
+static GHashTable *counters = NULL;
+static GHashTable *histograms = NULL;
+static gint64 start_time = 0;
+static guint owner_id = 0;
+static guint registration_id = 0;
+static GDBusConnection *connection = NULL;
+static GDBusNodeInfo *introspection = NULL;
+
+
+
+
+static void
+metrics_init (void)
+{
+	if (counters)
+		return;
+
+	counters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	histograms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	start_time = g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static GVariant *
+counters_to_variant (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+	g_hash_table_iter_init (&iter, counters);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_variant_builder_add (&builder, "{st}", key, *(guint64 *)value);
+
+	return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+histograms_to_variant (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tdat)}"));
+
+	g_hash_table_iter_init (&iter, histograms);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		Histogram *histogram = (Histogram *)value;
+		GVariant *buckets;
+
+		buckets = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                             histogram->buckets,
+                                             G_N_ELEMENTS (histogram->buckets),
+                                             sizeof (guint64));
+		g_variant_builder_add (&builder, "{s(td@at)}", key,
+                               histogram->count, histogram->sum, buckets);
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
+static void
+metrics_method_call (GDBusConnection       *conn,
+                     const gchar           *sender,
+                     const gchar           *object_path,
+                     const gchar           *interface_name,
+                     const gchar           *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               data)
+{
+	if (g_str_equal (method_name, "GetCounters")) {
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(@a{st})", counters_to_variant ()));
+	} else if (g_str_equal (method_name, "GetHistograms")) {
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(@a{s(tdat)})", histograms_to_variant ()));
+	} else {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                               "No such method %s", method_name);
+	}
+}
+
+static GVariant *
+metrics_get_property (GDBusConnection  *conn,
+                      const gchar      *sender,
+                      const gchar      *object_path,
+                      const gchar      *interface_name,
+                      const gchar      *property_name,
+                      GError          **error,
+                      gpointer          data)
+{
+	if (g_str_equal (property_name, "BucketBounds")) {
+		return g_variant_new_fixed_array (G_VARIANT_TYPE_DOUBLE,
+                                          bucket_bounds, G_N_ELEMENTS (bucket_bounds),
+                                          sizeof (gdouble));
+	} else if (g_str_equal (property_name, "StartTime")) {
+		return g_variant_new_int64 (start_time);
+	}
+
+	g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                 "No such property %s", property_name);
+
+	return NULL;
+}
+
+static const GDBusInterfaceVTable metrics_vtable = {
+	metrics_method_call,
+	metrics_get_property,
+	NULL
+};
+
+static void
+bus_acquired_cb (GDBusConnection *conn, const gchar *name, gpointer data)
+{
+	GError *error = NULL;
+
+	connection = g_object_ref (conn);
+	registration_id = g_dbus_connection_register_object (conn,
+                                                         METRICS_OBJECT_PATH,
+                                                         introspection->interfaces[0],
+                                                         &metrics_vtable,
+                                                         NULL, NULL, &error);
+	if (!registration_id) {
+		g_warning ("Could not export metrics: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+name_lost_cb (GDBusConnection *conn, const gchar *name, gpointer data)
+{
+	/* another instance has it; the object is still on our unique name */
+	g_debug ("Could not own %s", name);
+}
+
+void
+metrics_count (const gchar *counter, guint64 delta)
+{
+	g_return_if_fail (counter != NULL);
+
+	guint64 *value;
+
+	metrics_init ();
+
+	value = g_hash_table_lookup (counters, counter);
+	if (!value) {
+		value = g_new0 (guint64, 1);
+		g_hash_table_insert (counters, g_strdup (counter), value);
+	}
+
+	*value += delta;
+}
+
+void
+metrics_observe (const gchar *histogram, gdouble msec)
+{
+	g_return_if_fail (histogram != NULL);
+
+	guint i;
+	Histogram *h;
+
+	metrics_init ();
+
+	h = g_hash_table_lookup (histograms, histogram);
+	if (!h) {
+		h = g_new0 (Histogram, 1);
+		g_hash_table_insert (histograms, g_strdup (histogram), h);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (bucket_bounds) && msec > bucket_bounds[i]; i++);
+
+	h->buckets[i]++;
+	h->count++;
+	h->sum += msec;
+}
+
+/* puts the metrics on the session bus for as long as the process runs */
+void
+metrics_export (void)
+{
+	if (owner_id)
+		return;
+
+	metrics_init ();
+
+	introspection = g_dbus_node_info_new_for_xml (metrics_xml, NULL);
+	owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
+                               METRICS_BUS_NAME,
+                               G_BUS_NAME_OWNER_FLAGS_NONE,
+                               bus_acquired_cb,
+                               NULL,
+                               name_lost_cb,
+                               NULL, NULL);
+}
+
+void
+metrics_shutdown (void)
+{
+	if (owner_id) {
+		g_bus_unown_name (owner_id);
+		owner_id = 0;
+	}
+
+	if (registration_id) {
+		g_dbus_connection_unregister_object (connection, registration_id);
+		registration_id = 0;
+	}
+
+	g_clear_object (&connection);
+	g_clear_pointer (&introspection, g_dbus_node_info_unref);
+	g_clear_pointer (&counters, g_hash_table_destroy);
+	g_clear_pointer (&histograms, g_hash_table_destroy);
+}
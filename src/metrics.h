@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+
+#ifndef __METRICS_H__
+#define	__METRICS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void metrics_count    (const gchar *counter,
+                       guint64      delta);
+
+void metrics_observe  (const gchar *histogram,
+                       gdouble      msec);
+
+void metrics_export   (void);
+
+void metrics_shutdown (void);
+
+G_END_DECLS
+
+#endif
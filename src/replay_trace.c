@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <json-c/json.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "replay_trace.h"
+
+
+/*
+ * During an offline replay, side effects that would reach the live
+ * desktop are written to the trace instead of being applied. Each one
+ * is a line of JSON:
+ *
+ *   {"ms":12.5,"kind":"xfconf","target":"xsettings:/Net/IconThemeName","value":"Papirus"}
+ *
+ * ms counts from replay_trace_open (); value is a string, a list of
+ * strings or null. Kinds are "file" and "remove" for desktop files,
+ * "xfconf", "gconf", "spawn" and "dbus".
+ */
+static FILE *trace_fp = NULL;
+static gint64 trace_begin = 0;
+
+
+
+
+static void
+replay_trace_write (const gchar *kind, const gchar *target, json_object *value_obj)
+{
+	json_object *record_obj;
+
+	record_obj = json_object_new_object ();
+	json_object_object_add (record_obj, "ms",
+                            json_object_new_double ((gdouble)(g_get_monotonic_time () - trace_begin) / 1000.0));
+	json_object_object_add (record_obj, "kind", json_object_new_string (kind));
+	json_object_object_add (record_obj, "target", json_object_new_string (target));
+	json_object_object_add (record_obj, "value", value_obj);
+
+	fputs (json_object_to_json_string_ext (record_obj, JSON_C_TO_STRING_PLAIN), trace_fp);
+	fputc ('\n', trace_fp);
+
+	json_object_put (record_obj);
+}
+
+gboolean
+replay_trace_open (const gchar *file, GError **error)
+{
+	g_return_val_if_fail (file != NULL, FALSE);
+	g_return_val_if_fail (trace_fp == NULL, FALSE);
+
+	trace_fp = g_fopen (file, "w");
+	if (!trace_fp) {
+		int saved_errno = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                     "Could not open %s: %s", file, g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	trace_begin = g_get_monotonic_time ();
+
+	return TRUE;
+}
+
+void
+replay_trace_close (void)
+{
+	if (!trace_fp)
+		return;
+
+	if (fclose (trace_fp) != 0)
+		g_warning ("Could not write the replay trace: %s", g_strerror (errno));
+
+	trace_fp = NULL;
+}
+
+gboolean
+replay_trace_is_active (void)
+{
+	return (trace_fp != NULL);
+}
+
+void
+replay_trace_record (const gchar *kind, const gchar *target, const gchar *value)
+{
+	g_return_if_fail (kind != NULL && target != NULL);
+
+	if (!trace_fp)
+		return;
+
+	replay_trace_write (kind, target, value ? json_object_new_string (value) : NULL);
+}
+
+void
+replay_trace_record_list (const gchar *kind, const gchar *target, GSList *values)
+{
+	g_return_if_fail (kind != NULL && target != NULL);
+
+	GSList *l;
+	json_object *values_obj;
+
+	if (!trace_fp)
+		return;
+
+	values_obj = json_object_new_array ();
+	for (l = values; l; l = l->next)
+		json_object_array_add (values_obj, json_object_new_string ((const gchar *)l->data));
+
+	replay_trace_write (kind, target, values_obj);
+}
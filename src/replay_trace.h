@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+
+#ifndef __REPLAY_TRACE_H__
+#define	__REPLAY_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean replay_trace_open        (const gchar *file,
+                                   GError     **error);
+
+void     replay_trace_close       (void);
+
+gboolean replay_trace_is_active   (void);
+
+void     replay_trace_record      (const gchar *kind,
+                                   const gchar *target,
+                                   const gchar *value);
+
+void     replay_trace_record_list (const gchar *kind,
+                                   const gchar *target,
+                                   GSList      *values);
+
+G_END_DECLS
+
+#endif
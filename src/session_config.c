@@ -0,0 +1,605 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include <json-c/json.h>
+
+#include <glib.h>
+
+#include "session_config.h"
+
+#define	GRM_USER		".grm-user"
+
+#if JSON_C_VERSION_NUM >= ((0 << 16) | (15 << 8) | 0)
+#define	tokener_parse_end(tok)	json_tokener_get_parse_end (tok)
+#else
+#define	tokener_parse_end(tok)	((gsize)(tok)->char_offset)
+#endif
+
+
+/*
+ * .grm-user is read into one buffer. A small scanner walks the
+ * document and skips whatever this program does not use without
+ * allocating anything; json-c only parses the values that are used,
+ * each on its own, from where they sit in the buffer. Memory
+ * and time spent on a large .grm-user no longer depend on the parts
+ * of it that are ignored.
+ *
+ * The scanner checks the structure it walks through (strings, nesting
+ * and separators) but not the contents of the values it skips.
+ */
+typedef struct {
+	const gchar   *begin;
+	const gchar   *pos;
+	const gchar   *end;
+	json_tokener  *tokener;
+	SessionConfig *config;
+	gboolean       has_data;
+} ConfigParser;
+
+/* called with pos at the value of key; must leave pos after it */
+typedef gboolean (*ConfigMemberFunc) (ConfigParser *parser, const gchar *key, gpointer data);
+
+/* the members of an app that are used */
+typedef struct {
+	json_object *position;
+	json_object *desktop;
+} AppMembers;
+
+
+
+
+GQuark
+session_config_error_quark (void)
+{
+	return g_quark_from_static_string ("session-config-error-quark");
+}
+
+static gchar *
+config_json_dup_string (json_object *obj)
+{
+	if (!obj || json_object_is_type (obj, json_type_null))
+		return NULL;
+
+	return g_strdup (json_object_get_string (obj));
+}
+
+static void
+session_app_free (SessionApp *app)
+{
+	g_free (app->position);
+	g_free (app->name);
+	g_free (app->comment);
+	g_free (app->exec);
+	g_free (app->icon);
+	g_free (app);
+}
+
+static SessionApp *
+session_app_new_from_json (json_object *pos_obj, json_object *dt_obj, gint index)
+{
+	SessionApp *app;
+
+	if (!dt_obj || !pos_obj || !json_object_is_type (dt_obj, json_type_object))
+		return NULL;
+
+	app = g_new0 (SessionApp, 1);
+	app->index = index;
+	app->position = config_json_dup_string (pos_obj);
+
+	/* keys of the desktop object are matched case-insensitively */
+	json_object_object_foreach (dt_obj, key, val) {
+		gchar **field = NULL;
+
+		if (g_ascii_strcasecmp (key, "name") == 0) {
+			field = &app->name;
+		} else if (g_ascii_strcasecmp (key, "comment") == 0) {
+			field = &app->comment;
+		} else if (g_ascii_strcasecmp (key, "exec") == 0) {
+			field = &app->exec;
+		} else if (g_ascii_strcasecmp (key, "icon") == 0) {
+			field = &app->icon;
+		}
+
+		if (field) {
+			g_free (*field);
+			*field = config_json_dup_string (val);
+		}
+	}
+
+	return app;
+}
+
+static void
+parser_skip_ws (ConfigParser *parser)
+{
+	while (parser->pos < parser->end &&
+           (*parser->pos == ' ' || *parser->pos == '\t' ||
+            *parser->pos == '\n' || *parser->pos == '\r'))
+		parser->pos++;
+}
+
+static gboolean
+parser_peek (ConfigParser *parser, gchar c)
+{
+	parser_skip_ws (parser);
+
+	return (parser->pos < parser->end && *parser->pos == c);
+}
+
+static gboolean
+parser_expect (ConfigParser *parser, gchar c)
+{
+	if (!parser_peek (parser, c))
+		return FALSE;
+
+	parser->pos++;
+
+	return TRUE;
+}
+
+/* moves past the closing quote of the string at pos */
+static gboolean
+parser_skip_string (ConfigParser *parser)
+{
+	if (parser->pos >= parser->end || *parser->pos != '"')
+		return FALSE;
+
+	for (parser->pos++; parser->pos < parser->end; parser->pos++) {
+		if (*parser->pos == '"') {
+			parser->pos++;
+			return TRUE;
+		}
+
+		/* the escaped character cannot end the string */
+		if (*parser->pos == '\\' && ++parser->pos == parser->end)
+			break;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+is_literal_char (gchar c)
+{
+	return (g_ascii_isalnum (c) || c == '-' || c == '+' || c == '.');
+}
+
+/* moves past the value at pos without building anything */
+static gboolean
+parser_skip_value (ConfigParser *parser)
+{
+	gint depth = 0;
+
+	do {
+		parser_skip_ws (parser);
+		if (parser->pos >= parser->end)
+			return FALSE;
+
+		switch (*parser->pos) {
+			case '"':
+				if (!parser_skip_string (parser))
+					return FALSE;
+				break;
+			case '{':
+			case '[':
+				depth++;
+				parser->pos++;
+				break;
+			case '}':
+			case ']':
+				if (depth == 0)
+					return FALSE;
+				depth--;
+				parser->pos++;
+				break;
+			case ',':
+			case ':':
+				if (depth == 0)
+					return FALSE;
+				parser->pos++;
+				break;
+			default:
+				/* numbers, true, false and null */
+				if (!is_literal_char (*parser->pos))
+					return FALSE;
+				while (parser->pos < parser->end && is_literal_char (*parser->pos))
+					parser->pos++;
+				break;
+		}
+	} while (depth > 0);
+
+	return TRUE;
+}
+
+/* the value at pos as json-c sees it; a JSON null is a NULL *obj */
+static gboolean
+parser_parse_value (ConfigParser *parser, json_object **obj)
+{
+	gsize len;
+
+	parser_skip_ws (parser);
+
+	/* the rest of the document follows the value, json-c stops at its end */
+	len = MIN ((gsize)(parser->end - parser->pos), (gsize)G_MAXINT);
+
+	json_tokener_reset (parser->tokener);
+	*obj = json_tokener_parse_ex (parser->tokener, parser->pos, (int)len);
+
+	if (json_tokener_get_error (parser->tokener) != json_tokener_success) {
+		if (*obj)
+			json_object_put (*obj);
+		*obj = NULL;
+		return FALSE;
+	}
+
+	parser->pos += tokener_parse_end (parser->tokener);
+
+	return TRUE;
+}
+
+static gboolean
+parser_dup_string (ConfigParser *parser, gchar **field)
+{
+	json_object *obj = NULL;
+
+	if (!parser_parse_value (parser, &obj))
+		return FALSE;
+
+	/* a later duplicate of the key wins, as with json-c */
+	g_free (*field);
+	*field = config_json_dup_string (obj);
+
+	if (obj)
+		json_object_put (obj);
+
+	return TRUE;
+}
+
+static gchar *
+parser_parse_key (ConfigParser *parser)
+{
+	const gchar *begin = parser->pos;
+	json_object *obj = NULL;
+	gchar *key;
+
+	if (!parser_skip_string (parser))
+		return NULL;
+
+	/* keys rarely have escapes */
+	if (!memchr (begin, '\\', parser->pos - begin))
+		return g_strndup (begin + 1, parser->pos - begin - 2);
+
+	parser->pos = begin;
+	if (!parser_parse_value (parser, &obj) || !obj)
+		return NULL;
+
+	key = g_strdup (json_object_get_string (obj));
+	json_object_put (obj);
+
+	return key;
+}
+
+static gboolean
+parser_walk_object (ConfigParser *parser, ConfigMemberFunc func, gpointer data)
+{
+	if (!parser_expect (parser, '{'))
+		return FALSE;
+
+	if (parser_expect (parser, '}'))
+		return TRUE;
+
+	do {
+		gchar *key;
+		gboolean ret;
+
+		parser_skip_ws (parser);
+
+		key = parser_parse_key (parser);
+		if (!key)
+			return FALSE;
+
+		ret = parser_expect (parser, ':') && func (parser, key, data);
+		g_free (key);
+
+		if (!ret)
+			return FALSE;
+	} while (parser_expect (parser, ','));
+
+	return parser_expect (parser, '}');
+}
+
+/* anything other than an object is skipped, like a missing one */
+static gboolean
+parser_walk_object_or_skip (ConfigParser *parser, ConfigMemberFunc func, gpointer data)
+{
+	if (!parser_peek (parser, '{'))
+		return parser_skip_value (parser);
+
+	return parser_walk_object (parser, func, data);
+}
+
+static gboolean
+app_member (ConfigParser *parser, const gchar *key, gpointer data)
+{
+	AppMembers *members = (AppMembers *)data;
+	json_object **field = NULL;
+
+	if (g_str_equal (key, "position"))
+		field = &members->position;
+	else if (g_str_equal (key, "desktop"))
+		field = &members->desktop;
+
+	if (!field)
+		return parser_skip_value (parser);
+
+	if (*field)
+		json_object_put (*field);
+
+	return parser_parse_value (parser, field);
+}
+
+static gboolean
+parser_walk_apps (ConfigParser *parser)
+{
+	gint index = 0;
+	gboolean ret = TRUE;
+
+	if (!parser_peek (parser, '['))
+		return parser_skip_value (parser);
+
+	/* a later apps array replaces an earlier one */
+	g_ptr_array_set_size (parser->config->apps, 0);
+
+	parser->pos++;
+	if (parser_expect (parser, ']'))
+		return TRUE;
+
+	do {
+		AppMembers members = { NULL, NULL };
+		SessionApp *app;
+
+		/* the index counts every element, usable or not */
+		if (parser_peek (parser, '{')) {
+			ret = parser_walk_object (parser, app_member, &members);
+			if (ret) {
+				app = session_app_new_from_json (members.position, members.desktop, index);
+				if (app)
+					g_ptr_array_add (parser->config->apps, app);
+			}
+		} else {
+			ret = parser_skip_value (parser);
+		}
+
+		if (members.position)
+			json_object_put (members.position);
+		if (members.desktop)
+			json_object_put (members.desktop);
+
+		index++;
+	} while (ret && parser_expect (parser, ','));
+
+	return ret && parser_expect (parser, ']');
+}
+
+static gboolean
+login_info_member (ConfigParser *parser, const gchar *key, gpointer data)
+{
+	if (g_str_equal (key, "user_id"))
+		return parser_dup_string (parser, &parser->config->user_id);
+
+	return parser_skip_value (parser);
+}
+
+static gboolean
+desktop_info_member (ConfigParser *parser, const gchar *key, gpointer data)
+{
+	SessionConfig *config = parser->config;
+
+	if (g_str_equal (key, "themeNm"))
+		return parser_dup_string (parser, &config->theme);
+	if (g_str_equal (key, "wallpaperNm"))
+		return parser_dup_string (parser, &config->wallpaper_name);
+	if (g_str_equal (key, "wallpaperFile"))
+		return parser_dup_string (parser, &config->wallpaper_url);
+	if (g_str_equal (key, "apps"))
+		return parser_walk_apps (parser);
+
+	return parser_skip_value (parser);
+}
+
+static gboolean
+data_member (ConfigParser *parser, const gchar *key, gpointer data)
+{
+	if (g_str_equal (key, "loginInfo"))
+		return parser_walk_object_or_skip (parser, login_info_member, NULL);
+	if (g_str_equal (key, "desktopInfo"))
+		return parser_walk_object_or_skip (parser, desktop_info_member, NULL);
+
+	return parser_skip_value (parser);
+}
+
+static gboolean
+root_member (ConfigParser *parser, const gchar *key, gpointer data)
+{
+	if (!g_str_equal (key, "data"))
+		return parser_skip_value (parser);
+
+	if (!parser_peek (parser, '{'))
+		return parser_skip_value (parser);
+
+	parser->has_data = TRUE;
+
+	return parser_walk_object (parser, data_member, NULL);
+}
+
+gchar *
+session_config_get_path (void)
+{
+	return g_strdup_printf ("/var/run/user/%d/gooroom/%s", getuid (), GRM_USER);
+}
+
+SessionConfig *
+session_config_load (const gchar *file, GError **error)
+{
+	g_return_val_if_fail (file != NULL, NULL);
+
+	gboolean ret;
+	gchar *contents = NULL;
+	gsize length = 0;
+	ConfigParser parser;
+	SessionConfig *config;
+
+	/* not mapped: the agent may rewrite the file while a resident
+	 * reload is reading it, and a mapping would fault on truncation */
+	if (!g_file_get_contents (file, &contents, &length, error))
+		return NULL;
+
+	config = g_new0 (SessionConfig, 1);
+	config->apps = g_ptr_array_new_with_free_func ((GDestroyNotify) session_app_free);
+
+	parser.begin = contents;
+	parser.pos = parser.begin;
+	parser.end = parser.begin + length;
+	parser.tokener = json_tokener_new ();
+	parser.config = config;
+	parser.has_data = FALSE;
+
+	ret = parser_walk_object (&parser, root_member, NULL);
+
+	if (!ret) {
+		g_set_error (error, SESSION_CONFIG_ERROR, SESSION_CONFIG_ERROR_PARSE,
+                     "Could not parse %s at offset %" G_GSIZE_FORMAT,
+                     file, (gsize)(parser.pos - parser.begin));
+	} else if (!parser.has_data) {
+		g_set_error (error, SESSION_CONFIG_ERROR, SESSION_CONFIG_ERROR_INVALID,
+                     "No data in %s", file);
+	}
+
+	if (!ret || !parser.has_data) {
+		session_config_free (config);
+		config = NULL;
+	}
+
+	json_tokener_free (parser.tokener);
+	g_free (contents);
+
+	return config;
+}
+
+void
+session_config_free (SessionConfig *config)
+{
+	if (!config)
+		return;
+
+	g_free (config->user_id);
+	g_free (config->theme);
+	g_free (config->wallpaper_name);
+	g_free (config->wallpaper_url);
+	g_ptr_array_free (config->apps, TRUE);
+	g_free (config);
+}
+
+gboolean
+session_config_is_owned_by (SessionConfig *config, const gchar *user_name)
+{
+	g_return_val_if_fail (config != NULL, FALSE);
+
+	return (config->user_id && g_strcmp0 (config->user_id, user_name) == 0);
+}
+
+/* everything differs from a missing config */
+SessionConfigChanges
+session_config_diff (SessionConfig *old_config, SessionConfig *new_config)
+{
+	guint i;
+	SessionConfigChanges changes = SESSION_CONFIG_CHANGED_NONE;
+
+	if (!old_config || !new_config)
+		return SESSION_CONFIG_CHANGED_ALL;
+
+	if (g_strcmp0 (old_config->user_id, new_config->user_id) != 0)
+		changes |= SESSION_CONFIG_CHANGED_USER;
+
+	if (g_strcmp0 (old_config->theme, new_config->theme) != 0)
+		changes |= SESSION_CONFIG_CHANGED_THEME;
+
+	if (g_strcmp0 (old_config->wallpaper_name, new_config->wallpaper_name) != 0 ||
+        g_strcmp0 (old_config->wallpaper_url, new_config->wallpaper_url) != 0)
+		changes |= SESSION_CONFIG_CHANGED_WALLPAPER;
+
+	if (old_config->apps->len != new_config->apps->len) {
+		changes |= SESSION_CONFIG_CHANGED_APPS;
+	} else {
+		for (i = 0; i < new_config->apps->len; i++) {
+			if (!session_app_equal (g_ptr_array_index (old_config->apps, i),
+                                    g_ptr_array_index (new_config->apps, i))) {
+				changes |= SESSION_CONFIG_CHANGED_APPS;
+				break;
+			}
+		}
+	}
+
+	return changes;
+}
+
+SessionApp *
+session_config_find_app (SessionConfig *config, gint index)
+{
+	g_return_val_if_fail (config != NULL, NULL);
+
+	guint i;
+
+	for (i = 0; i < config->apps->len; i++) {
+		SessionApp *app = g_ptr_array_index (config->apps, i);
+		if (app->index == index)
+			return app;
+	}
+
+	return NULL;
+}
+
+gboolean
+session_app_equal (SessionApp *a, SessionApp *b)
+{
+	if (!a || !b)
+		return (a == b);
+
+	return (a->index == b->index &&
+            g_strcmp0 (a->position, b->position) == 0 &&
+            g_strcmp0 (a->name, b->name) == 0 &&
+            g_strcmp0 (a->comment, b->comment) == 0 &&
+            g_strcmp0 (a->exec, b->exec) == 0 &&
+            g_strcmp0 (a->icon, b->icon) == 0);
+}
+
+gboolean
+session_app_has_remote_icon (SessionApp *app)
+{
+	g_return_val_if_fail (app != NULL, FALSE);
+
+	return (app->icon &&
+            (g_str_has_prefix (app->icon, "http://") || g_str_has_prefix (app->icon, "https://")));
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __SESSION_CONFIG_H__
+#define	__SESSION_CONFIG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define	SESSION_CONFIG_ERROR	(session_config_error_quark ())
+
+typedef enum {
+	SESSION_CONFIG_ERROR_PARSE,
+	SESSION_CONFIG_ERROR_INVALID
+} SessionConfigError;
+
+/* what session_config_diff () found to differ */
+typedef enum {
+	SESSION_CONFIG_CHANGED_NONE      = 0,
+	SESSION_CONFIG_CHANGED_USER      = 1 << 0,
+	SESSION_CONFIG_CHANGED_THEME     = 1 << 1,
+	SESSION_CONFIG_CHANGED_WALLPAPER = 1 << 2,
+	SESSION_CONFIG_CHANGED_APPS      = 1 << 3,
+	SESSION_CONFIG_CHANGED_ALL       = 0xf
+} SessionConfigChanges;
+
+/* one entry of desktopInfo.apps */
+typedef struct {
+	gint   index;
+	gchar *position;
+	gchar *name;
+	gchar *comment;
+	gchar *exec;
+	gchar *icon;
+} SessionApp;
+
+/* the parts of .grm-user this program uses */
+typedef struct {
+	gchar     *user_id;
+	gchar     *theme;
+	gchar     *wallpaper_name;
+	gchar     *wallpaper_url;
+	GPtrArray *apps;
+} SessionConfig;
+
+GQuark         session_config_error_quark   (void);
+
+gchar         *session_config_get_path      (void);
+
+SessionConfig *session_config_load          (const gchar    *file,
+                                             GError        **error);
+
+void           session_config_free          (SessionConfig  *config);
+
+gboolean       session_config_is_owned_by   (SessionConfig  *config,
+                                             const gchar    *user_name);
+
+SessionConfigChanges
+               session_config_diff          (SessionConfig  *old_config,
+                                             SessionConfig  *new_config);
+
+SessionApp    *session_config_find_app      (SessionConfig  *config,
+                                             gint            index);
+
+gboolean       session_app_equal            (SessionApp     *a,
+                                             SessionApp     *b);
+
+gboolean       session_app_has_remote_icon  (SessionApp     *app);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "replay_trace.h"
+#include "staged_dir.h"
+
+
+
+
+static gchar *
+staged_dir_make_temp (void)
+{
+	gchar *base, *path;
+
+	/* next to the published directories so that rename () works */
+	base = g_build_filename (g_get_user_data_dir (), PACKAGE_NAME, NULL);
+	g_mkdir_with_parents (base, 0700);
+
+	path = g_build_filename (base, "staging-XXXXXX", NULL);
+	g_free (base);
+
+	if (!g_mkdtemp_full (path, 0755)) {
+		g_free (path);
+		return NULL;
+	}
+
+	return path;
+}
+
+static void
+remove_recursive (const gchar *path)
+{
+	struct stat st;
+
+	if (g_lstat (path, &st) != 0)
+		return;
+
+	if (S_ISDIR (st.st_mode)) {
+		GDir *dir = g_dir_open (path, 0, NULL);
+		if (dir) {
+			const gchar *name;
+			while ((name = g_dir_read_name (dir)) != NULL) {
+				gchar *child = g_build_filename (path, name, NULL);
+				remove_recursive (child);
+				g_free (child);
+			}
+			g_dir_close (dir);
+		}
+		g_rmdir (path);
+	} else {
+		g_remove (path);
+	}
+}
+
+static gboolean
+file_matches (const gchar *path, const gchar *data)
+{
+	gboolean ret;
+	gchar *contents = NULL;
+
+	ret = (g_file_get_contents (path, &contents, NULL, NULL) && g_strcmp0 (contents, data) == 0);
+	g_free (contents);
+
+	return ret;
+}
+
+/* names of files whose contents differ and of entries not in files, each in name order */
+static void
+staged_dir_diff (const gchar  *dir_path,
+                 GHashTable   *files,
+                 GList       **changed,
+                 GList       **stale)
+{
+	GDir *dir;
+	GHashTableIter iter;
+	gpointer key, value;
+	const gchar *name;
+
+	*changed = NULL;
+	*stale = NULL;
+
+	g_hash_table_iter_init (&iter, files);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		gchar *path = g_build_filename (dir_path, (const gchar *)key, NULL);
+		if (!file_matches (path, (const gchar *)value))
+			*changed = g_list_prepend (*changed, key);
+		g_free (path);
+	}
+	*changed = g_list_sort (*changed, (GCompareFunc) g_strcmp0);
+
+	dir = g_dir_open (dir_path, 0, NULL);
+	if (!dir)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (!g_hash_table_contains (files, name))
+			*stale = g_list_prepend (*stale, g_strdup (name));
+	}
+	*stale = g_list_sort (*stale, (GCompareFunc) g_strcmp0);
+
+	g_dir_close (dir);
+}
+
+static gboolean
+write_files (const gchar *dir_path, GHashTable *files, GList *names)
+{
+	GList *l;
+
+	for (l = names; l; l = l->next) {
+		gboolean ret;
+		gchar *path = g_build_filename (dir_path, (const gchar *)l->data, NULL);
+
+		ret = g_file_set_contents (path, g_hash_table_lookup (files, l->data), -1, NULL);
+		g_free (path);
+
+		if (!ret)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * The directory itself is kept, so a monitor on it stays valid. The
+ * changed files are all written to staging first; only then are the
+ * stale entries removed and the staged files renamed in, one pass
+ * with no writes in between. Watchers may see each of these steps,
+ * but never a half-written file, and nothing at all is touched when
+ * staging fails.
+ */
+static gboolean
+update_in_place (const gchar *dir_path,
+                 const gchar *staging,
+                 GHashTable  *files,
+                 GList       *changed,
+                 GList       *stale)
+{
+	gboolean ret = TRUE;
+	GList *l;
+
+	if (!write_files (staging, files, changed))
+		return FALSE;
+
+	for (l = stale; l; l = l->next) {
+		gchar *path = g_build_filename (dir_path, (const gchar *)l->data, NULL);
+		remove_recursive (path);
+		g_free (path);
+	}
+
+	for (l = changed; l; l = l->next) {
+		gchar *src = g_build_filename (staging, (const gchar *)l->data, NULL);
+		gchar *dest = g_build_filename (dir_path, (const gchar *)l->data, NULL);
+
+		if (g_rename (src, dest) != 0)
+			ret = FALSE;
+
+		g_free (dest);
+		g_free (src);
+	}
+
+	return ret;
+}
+
+/* the steps staged_dir_publish () would take, in the same order */
+static void
+staged_dir_trace (const gchar *dir, GHashTable *files, GList *changed, GList *stale)
+{
+	GList *l;
+
+	for (l = stale; l; l = l->next) {
+		gchar *path = g_build_filename (dir, (const gchar *)l->data, NULL);
+		replay_trace_record ("remove", path, NULL);
+		g_free (path);
+	}
+
+	for (l = changed; l; l = l->next) {
+		gchar *path = g_build_filename (dir, (const gchar *)l->data, NULL);
+		replay_trace_record ("file", path, g_hash_table_lookup (files, l->data));
+		g_free (path);
+	}
+}
+
+/* Replaces the contents of dir with files (name -> contents). Nothing
+ * is touched when the directory is already up to date, and only the
+ * changed and stale entries are when it exists; a new directory is
+ * staged and appears with all of its files at once. */
+gboolean
+staged_dir_publish (const gchar *dir, GHashTable *files)
+{
+	g_return_val_if_fail (dir != NULL && files != NULL, FALSE);
+
+	gboolean ret = FALSE, exists;
+	gchar *parent, *staging;
+	GList *changed, *stale;
+
+	exists = g_file_test (dir, G_FILE_TEST_IS_DIR);
+
+	staged_dir_diff (dir, files, &changed, &stale);
+
+	if (exists && !changed && !stale) {
+		ret = TRUE;
+		goto done;
+	}
+
+	if (replay_trace_is_active ()) {
+		staged_dir_trace (dir, files, changed, stale);
+		ret = TRUE;
+		goto done;
+	}
+
+	staging = staged_dir_make_temp ();
+	if (!staging)
+		goto done;
+
+	if (exists) {
+		ret = update_in_place (dir, staging, files, changed, stale);
+	} else {
+		parent = g_path_get_dirname (dir);
+		g_mkdir_with_parents (parent, 0755);
+		g_free (parent);
+
+		if (write_files (staging, files, changed))
+			ret = (g_rename (staging, dir) == 0);
+	}
+
+	remove_recursive (staging);
+	g_free (staging);
+
+done:
+	g_list_free_full (stale, g_free);
+	g_list_free (changed);
+
+	return ret;
+}
+
+gboolean
+staged_dir_remove (const gchar *dir)
+{
+	g_return_val_if_fail (dir != NULL, FALSE);
+
+	gchar *trash;
+
+	if (!g_file_test (dir, G_FILE_TEST_EXISTS))
+		return TRUE;
+
+	if (replay_trace_is_active ()) {
+		replay_trace_record ("remove", dir, NULL);
+		return TRUE;
+	}
+
+	/* take the whole directory away at once, then clean up */
+	trash = staged_dir_make_temp ();
+	if (trash && g_rename (dir, trash) == 0) {
+		remove_recursive (trash);
+	} else {
+		remove_recursive (dir);
+		if (trash)
+			g_rmdir (trash);
+	}
+	g_free (trash);
+
+	return !g_file_test (dir, G_FILE_TEST_EXISTS);
+}
@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "systemd_client.h"
+
+#define	SYSTEMD_BUS_NAME		"org.freedesktop.systemd1"
+#define	SYSTEMD_OBJECT_PATH		"/org/freedesktop/systemd1"
+#define	SYSTEMD_MANAGER_IFACE	"org.freedesktop.systemd1.Manager"
+
+
+/*
+ * One system bus client for the systemd manager. Calls made before the
+ * proxy is ready are queued and dispatched once it is.
+ */
+struct _SystemdClient {
+	GDBusProxy *manager;
+	gboolean    connecting;
+	GList      *pending;
+};
+
+typedef struct {
+	gchar    *method;
+	GVariant *parameters;
+	gint      timeout_msec;
+} SystemdCall;
+
+
+static SystemdClient *default_client = NULL;
+
+
+
+
+static void
+systemd_call_free (SystemdCall *call)
+{
+	g_free (call->method);
+	if (call->parameters)
+		g_variant_unref (call->parameters);
+	g_free (call);
+}
+
+static void
+systemd_call_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GTask *task = G_TASK (data);
+	GError *error = NULL;
+	GVariant *variant;
+
+	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (variant) {
+		g_task_return_pointer (task, variant, (GDestroyNotify) g_variant_unref);
+	} else {
+		g_task_return_error (task, error);
+	}
+
+	g_object_unref (task);
+}
+
+static void
+systemd_client_dispatch (SystemdClient *client, GTask *task)
+{
+	SystemdCall *call = g_task_get_task_data (task);
+
+	g_dbus_proxy_call (client->manager,
+                       call->method,
+                       call->parameters,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       call->timeout_msec,
+                       g_task_get_cancellable (task),
+                       systemd_call_done_cb,
+                       task);
+}
+
+static void
+systemd_client_manager_ready_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	SystemdClient *client = (SystemdClient *)data;
+	GError *error = NULL;
+	GDBusProxy *manager;
+	GList *pending, *l;
+
+	manager = g_dbus_proxy_new_for_bus_finish (res, &error);
+
+	client->connecting = FALSE;
+	client->manager = manager;
+
+	pending = client->pending;
+	client->pending = NULL;
+
+	for (l = pending; l; l = l->next) {
+		GTask *task = G_TASK (l->data);
+
+		if (g_task_return_error_if_cancelled (task)) {
+			g_object_unref (task);
+		} else if (client->manager) {
+			systemd_client_dispatch (client, task);
+		} else {
+			g_task_return_error (task, g_error_copy (error));
+			g_object_unref (task);
+		}
+	}
+	g_list_free (pending);
+
+	if (error)
+		g_error_free (error);
+}
+
+SystemdClient *
+systemd_client_get_default (void)
+{
+	if (!default_client)
+		default_client = g_new0 (SystemdClient, 1);
+
+	return default_client;
+}
+
+void
+systemd_client_free (SystemdClient *client)
+{
+	GList *l;
+
+	if (!client)
+		return;
+
+	if (client == default_client)
+		default_client = NULL;
+
+	/* calls still waiting for the manager proxy complete as cancelled */
+	for (l = client->pending; l; l = l->next) {
+		GTask *task = G_TASK (l->data);
+
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                 "The systemd client was freed");
+		g_object_unref (task);
+	}
+	g_list_free (client->pending);
+
+	g_clear_object (&client->manager);
+	g_free (client);
+}
+
+/* frees the default client, if there is one */
+void
+systemd_client_free_default (void)
+{
+	systemd_client_free (default_client);
+}
+
+void
+systemd_client_call (SystemdClient        *client,
+                     const gchar          *method,
+                     GVariant             *parameters,
+                     gint                  timeout_msec,
+                     GCancellable         *cancellable,
+                     GAsyncReadyCallback   callback,
+                     gpointer              user_data)
+{
+	g_return_if_fail (client != NULL && method != NULL);
+
+	GTask *task;
+	SystemdCall *call;
+
+	call = g_new0 (SystemdCall, 1);
+	call->method = g_strdup (method);
+	call->parameters = parameters ? g_variant_ref_sink (parameters) : NULL;
+	call->timeout_msec = timeout_msec;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_task_data (task, call, (GDestroyNotify) systemd_call_free);
+
+	if (client->manager) {
+		systemd_client_dispatch (client, task);
+		return;
+	}
+
+	/* queued until the manager proxy is ready */
+	client->pending = g_list_append (client->pending, task);
+
+	if (!client->connecting) {
+		client->connecting = TRUE;
+		g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                  NULL,
+                                  SYSTEMD_BUS_NAME,
+                                  SYSTEMD_OBJECT_PATH,
+                                  SYSTEMD_MANAGER_IFACE,
+                                  NULL,
+                                  systemd_client_manager_ready_cb,
+                                  client);
+	}
+}
+
+GVariant *
+systemd_client_call_finish (SystemdClient  *client,
+                            GAsyncResult   *res,
+                            GError        **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __SYSTEMD_CLIENT_H__
+#define	__SYSTEMD_CLIENT_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SystemdClient SystemdClient;
+
+SystemdClient *systemd_client_get_default     (void);
+
+void           systemd_client_free            (SystemdClient        *client);
+
+void           systemd_client_free_default    (void);
+
+void           systemd_client_call            (SystemdClient        *client,
+                                               const gchar          *method,
+                                               GVariant             *parameters,
+                                               gint                  timeout_msec,
+                                               GCancellable         *cancellable,
+                                               GAsyncReadyCallback   callback,
+                                               gpointer              user_data);
+
+GVariant      *systemd_client_call_finish     (SystemdClient        *client,
+                                               GAsyncResult         *res,
+                                               GError              **error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "task_graph.h"
+
+
+/*
+ * Jobs run on the main loop. A job starts from an idle callback as soon
+ * as everything it depends on has succeeded, and finishes when its code
+ * calls task_graph_job_done (), possibly much later. A job whose deadline
+ * passes is cancelled and counted as failed; its late task_graph_job_done ()
+ * is ignored. Jobs depending on a failed job are skipped.
+ *
+ * Dependencies can only point at jobs added earlier, so there are no cycles.
+ * The graph frees itself once every job has finished and every started
+ * job has called task_graph_job_done ().
+ */
+typedef enum {
+	JOB_STATE_PENDING,
+	JOB_STATE_RUNNING,
+	JOB_STATE_DONE
+} JobState;
+
+struct _TaskGraphJob {
+	TaskGraph     *graph;
+	guint          index;
+	gchar         *name;
+	TaskGraphFunc  func;
+	gpointer       user_data;
+	guint          deadline;
+
+	GPtrArray     *dependents;
+	guint          n_waiting;
+	gboolean       dependency_failed;
+
+	JobState       state;
+	gboolean       returned;
+	gboolean       success;
+	gint64         start_time;
+	GCancellable  *cancellable;
+	guint          start_id;
+	guint          deadline_id;
+};
+
+struct _TaskGraph {
+	GPtrArray         *jobs;
+	guint              n_unfinished;
+	guint              n_failed;
+	gboolean           running;
+	gboolean           cancelled;
+	guint              free_id;
+	TaskGraphDoneFunc  func;
+	gpointer           user_data;
+};
+
+
+static void task_graph_job_schedule (TaskGraphJob *job);
+
+
+
+
+static void
+task_graph_job_free (TaskGraphJob *job)
+{
+	if (job->start_id)
+		g_source_remove (job->start_id);
+	if (job->deadline_id)
+		g_source_remove (job->deadline_id);
+
+	g_ptr_array_free (job->dependents, TRUE);
+	g_object_unref (job->cancellable);
+	g_free (job->name);
+	g_free (job);
+}
+
+static void
+task_graph_free (TaskGraph *graph)
+{
+	g_ptr_array_free (graph->jobs, TRUE);
+	g_free (graph);
+}
+
+static gboolean
+task_graph_free_idle (gpointer data)
+{
+	task_graph_free ((TaskGraph *)data);
+
+	return FALSE;
+}
+
+static void
+task_graph_maybe_free (TaskGraph *graph)
+{
+	guint i;
+
+	if (graph->n_unfinished > 0 || graph->free_id)
+		return;
+
+	for (i = 0; i < graph->jobs->len; i++) {
+		TaskGraphJob *job = g_ptr_array_index (graph->jobs, i);
+		if (!job->returned)
+			return;
+	}
+
+	/* callers may still be walking the jobs */
+	graph->free_id = g_idle_add (task_graph_free_idle, graph);
+}
+
+static void
+task_graph_job_finish (TaskGraphJob *job, gboolean success)
+{
+	TaskGraph *graph = job->graph;
+	guint i;
+
+	if (job->state == JOB_STATE_DONE)
+		return;
+
+	if (job->start_time > 0) {
+		g_debug ("%s %s after %.3f s", job->name, success ? "finished" : "failed",
+                 (g_get_monotonic_time () - job->start_time) / (gdouble) G_USEC_PER_SEC);
+	}
+
+	job->state = JOB_STATE_DONE;
+	job->success = success;
+
+	if (job->deadline_id) {
+		g_source_remove (job->deadline_id);
+		job->deadline_id = 0;
+	}
+
+	if (!success)
+		graph->n_failed++;
+
+	for (i = 0; i < job->dependents->len; i++) {
+		TaskGraphJob *dependent = g_ptr_array_index (job->dependents, i);
+
+		if (!success)
+			dependent->dependency_failed = TRUE;
+
+		if (--dependent->n_waiting == 0)
+			task_graph_job_schedule (dependent);
+	}
+
+	if (--graph->n_unfinished == 0 && graph->func)
+		graph->func (graph, graph->user_data);
+
+	task_graph_maybe_free (graph);
+}
+
+static gboolean
+task_graph_job_deadline_cb (gpointer data)
+{
+	TaskGraphJob *job = (TaskGraphJob *)data;
+
+	job->deadline_id = 0;
+
+	g_warning ("%s did not finish within %u seconds", job->name, job->deadline);
+
+	g_cancellable_cancel (job->cancellable);
+	task_graph_job_finish (job, FALSE);
+
+	return FALSE;
+}
+
+static gboolean
+task_graph_job_start_cb (gpointer data)
+{
+	TaskGraphJob *job = (TaskGraphJob *)data;
+
+	job->start_id = 0;
+	job->state = JOB_STATE_RUNNING;
+	job->start_time = g_get_monotonic_time ();
+
+	if (job->deadline > 0) {
+		job->deadline_id = g_timeout_add_seconds (job->deadline,
+                                                  task_graph_job_deadline_cb, job);
+	}
+
+	job->func (job, job->user_data);
+
+	return FALSE;
+}
+
+static void
+task_graph_job_schedule (TaskGraphJob *job)
+{
+	if (job->graph->cancelled || job->dependency_failed) {
+		g_debug ("%s skipped", job->name);
+		job->returned = TRUE;
+		task_graph_job_finish (job, FALSE);
+		return;
+	}
+
+	job->start_id = g_idle_add (task_graph_job_start_cb, job);
+}
+
+TaskGraph *
+task_graph_new (void)
+{
+	TaskGraph *graph;
+
+	graph = g_new0 (TaskGraph, 1);
+	graph->jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) task_graph_job_free);
+
+	return graph;
+}
+
+/* deadline is in seconds, 0 for none */
+TaskGraphJob *
+task_graph_add (TaskGraph     *graph,
+                const gchar   *name,
+                TaskGraphFunc  func,
+                gpointer       user_data,
+                guint          deadline)
+{
+	g_return_val_if_fail (graph != NULL && !graph->running, NULL);
+	g_return_val_if_fail (name != NULL && func != NULL, NULL);
+
+	TaskGraphJob *job;
+
+	job = g_new0 (TaskGraphJob, 1);
+	job->graph = graph;
+	job->index = graph->jobs->len;
+	job->name = g_strdup (name);
+	job->func = func;
+	job->user_data = user_data;
+	job->deadline = deadline;
+	job->dependents = g_ptr_array_new ();
+	job->cancellable = g_cancellable_new ();
+
+	g_ptr_array_add (graph->jobs, job);
+
+	return job;
+}
+
+void
+task_graph_job_depends_on (TaskGraphJob *job, TaskGraphJob *dependency)
+{
+	g_return_if_fail (job != NULL && dependency != NULL);
+	g_return_if_fail (job->graph == dependency->graph && !job->graph->running);
+	g_return_if_fail (dependency->index < job->index);
+
+	g_ptr_array_add (dependency->dependents, job);
+	job->n_waiting++;
+}
+
+/* func is called once every job has finished, failed or been skipped */
+void
+task_graph_run (TaskGraph *graph, TaskGraphDoneFunc func, gpointer user_data)
+{
+	g_return_if_fail (graph != NULL && !graph->running);
+
+	guint i;
+
+	graph->running = TRUE;
+	graph->func = func;
+	graph->user_data = user_data;
+	graph->n_unfinished = graph->jobs->len;
+
+	if (graph->jobs->len == 0) {
+		if (func)
+			func (graph, user_data);
+		task_graph_maybe_free (graph);
+		return;
+	}
+
+	for (i = 0; i < graph->jobs->len; i++) {
+		TaskGraphJob *job = g_ptr_array_index (graph->jobs, i);
+		if (job->n_waiting == 0)
+			task_graph_job_schedule (job);
+	}
+}
+
+void
+task_graph_cancel (TaskGraph *graph)
+{
+	g_return_if_fail (graph != NULL);
+
+	guint i;
+
+	if (!graph->running || graph->cancelled)
+		return;
+
+	graph->cancelled = TRUE;
+
+	for (i = 0; i < graph->jobs->len; i++) {
+		TaskGraphJob *job = g_ptr_array_index (graph->jobs, i);
+
+		if (job->state == JOB_STATE_DONE)
+			continue;
+
+		if (job->start_id) {
+			g_source_remove (job->start_id);
+			job->start_id = 0;
+			job->returned = TRUE;
+		} else if (job->state == JOB_STATE_PENDING) {
+			/* skipped once its dependencies finish */
+			continue;
+		}
+
+		g_cancellable_cancel (job->cancellable);
+		task_graph_job_finish (job, FALSE);
+	}
+}
+
+guint
+task_graph_get_failed (TaskGraph *graph)
+{
+	g_return_val_if_fail (graph != NULL, 0);
+
+	return graph->n_failed;
+}
+
+gpointer
+task_graph_job_get_data (TaskGraphJob *job)
+{
+	g_return_val_if_fail (job != NULL, NULL);
+
+	return job->user_data;
+}
+
+GCancellable *
+task_graph_job_get_cancellable (TaskGraphJob *job)
+{
+	g_return_val_if_fail (job != NULL, NULL);
+
+	return job->cancellable;
+}
+
+void
+task_graph_job_done (TaskGraphJob *job, gboolean success)
+{
+	g_return_if_fail (job != NULL && !job->returned);
+
+	job->returned = TRUE;
+
+	task_graph_job_finish (job, success);
+	task_graph_maybe_free (job->graph);
+}
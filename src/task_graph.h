@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __TASK_GRAPH_H__
+#define	__TASK_GRAPH_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TaskGraph    TaskGraph;
+typedef struct _TaskGraphJob TaskGraphJob;
+
+typedef void (*TaskGraphFunc)     (TaskGraphJob *job, gpointer user_data);
+typedef void (*TaskGraphDoneFunc) (TaskGraph    *graph, gpointer user_data);
+
+TaskGraph    *task_graph_new                 (void);
+
+TaskGraphJob *task_graph_add                 (TaskGraph         *graph,
+                                              const gchar       *name,
+                                              TaskGraphFunc      func,
+                                              gpointer           user_data,
+                                              guint              deadline);
+
+void          task_graph_job_depends_on      (TaskGraphJob      *job,
+                                              TaskGraphJob      *dependency);
+
+void          task_graph_run                 (TaskGraph         *graph,
+                                              TaskGraphDoneFunc  func,
+                                              gpointer           user_data);
+
+void          task_graph_cancel              (TaskGraph         *graph);
+
+guint         task_graph_get_failed          (TaskGraph         *graph);
+
+gpointer      task_graph_job_get_data        (TaskGraphJob      *job);
+
+GCancellable *task_graph_job_get_cancellable (TaskGraphJob      *job);
+
+void          task_graph_job_done            (TaskGraphJob      *job,
+                                              gboolean           success);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "wallpaper_variants.h"
+
+#define	VARIANTS_DIR		"gooroom-autostart-program/wallpapers"
+#define	JPEG_QUALITY		"95"
+
+
+/*
+ * The wallpaper is decoded once and scaled down for every connected
+ * monitor that is smaller than it. The variants are cached by source
+ * file and size, so later logins with the same wallpaper decode
+ * nothing. Variants keep the aspect ratio and cover the monitor, which
+ * leaves xfdesktop's image style with the same result as before.
+ */
+struct _WallpaperVariants {
+	gchar      *source;
+	GHashTable *monitors;
+};
+
+
+
+
+static gchar *
+variants_get_dir (void)
+{
+	gchar *dir = g_build_filename (g_get_user_cache_dir (), VARIANTS_DIR, NULL);
+
+	g_mkdir_with_parents (dir, 0700);
+
+	return dir;
+}
+
+/* names the source by path, size and mtime, so a replaced file gets new variants */
+static gchar *
+variants_get_key (const gchar *source)
+{
+	GStatBuf st;
+	gchar *str, *key;
+
+	if (g_stat (source, &st) != 0)
+		return NULL;
+
+	str = g_strdup_printf ("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                           source, (gint64) st.st_size, (gint64) st.st_mtime);
+	key = g_compute_checksum_for_string (G_CHECKSUM_SHA1, str, -1);
+	g_free (str);
+
+	return key;
+}
+
+/*
+ * The name xfdesktop uses in /backdrop/screenN/monitorX: the monitor
+ * model with whitespace removed, or the index when there is no model.
+ */
+static gchar *
+variants_get_monitor_name (GdkMonitor *monitor, gint index)
+{
+	const gchar *model;
+	GString *name;
+
+	model = gdk_monitor_get_model (monitor);
+	if (!model || !*model)
+		return g_strdup_printf ("monitor%d", index);
+
+	name = g_string_new ("monitor");
+	for (; *model; model++) {
+		if (!g_ascii_isspace (*model))
+			g_string_append_c (name, *model);
+	}
+
+	return g_string_free (name, FALSE);
+}
+
+static void
+variants_prune (const gchar *dir, GHashTable *keep)
+{
+	GDir *gdir;
+	const gchar *name;
+
+	gdir = g_dir_open (dir, 0, NULL);
+	if (!gdir)
+		return;
+
+	while ((name = g_dir_read_name (gdir)) != NULL) {
+		gchar *path = g_build_filename (dir, name, NULL);
+		if (!g_hash_table_contains (keep, path))
+			g_remove (path);
+		g_free (path);
+	}
+
+	g_dir_close (gdir);
+}
+
+static gboolean
+variant_write (GdkPixbuf   *source,
+               gint         width,
+               gint         height,
+               const gchar *type,
+               const gchar *path)
+{
+	gboolean ret;
+	gchar *tmp;
+	GdkPixbuf *scaled;
+	GError *error = NULL;
+
+	scaled = gdk_pixbuf_scale_simple (source, width, height, GDK_INTERP_BILINEAR);
+	if (!scaled)
+		return FALSE;
+
+	tmp = g_strdup_printf ("%s.tmp", path);
+
+	if (g_str_equal (type, "jpeg")) {
+		ret = gdk_pixbuf_save (scaled, tmp, type, &error, "quality", JPEG_QUALITY, NULL);
+	} else {
+		ret = gdk_pixbuf_save (scaled, tmp, type, &error, NULL);
+	}
+
+	if (ret) {
+		ret = (g_rename (tmp, path) == 0);
+	} else {
+		g_warning ("Failed to write wallpaper variant %s: %s", path, error->message);
+		g_error_free (error);
+	}
+
+	if (!ret)
+		g_remove (tmp);
+
+	g_free (tmp);
+	g_object_unref (scaled);
+
+	return ret;
+}
+
+WallpaperVariants *
+wallpaper_variants_new (const gchar *source)
+{
+	g_return_val_if_fail (source != NULL, NULL);
+
+	gint i, n_monitors;
+	gint src_width = 0, src_height = 0;
+	gchar *dir, *key, *format_name;
+	const gchar *type;
+	GdkDisplay *display;
+	GdkPixbuf *pixbuf = NULL;
+	GdkPixbufFormat *format;
+	GHashTable *keep;
+	WallpaperVariants *variants;
+
+	variants = g_new0 (WallpaperVariants, 1);
+	variants->source = g_strdup (source);
+	variants->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	display = gdk_display_get_default ();
+	if (!display)
+		return variants;
+
+	/* only the header is read here */
+	format = gdk_pixbuf_get_file_info (source, &src_width, &src_height);
+	if (!format || src_width <= 0 || src_height <= 0)
+		return variants;
+
+	key = variants_get_key (source);
+	if (!key)
+		return variants;
+
+	/* photos stay JPEG, anything that may carry alpha becomes PNG */
+	format_name = gdk_pixbuf_format_get_name (format);
+	type = g_strcmp0 (format_name, "jpeg") == 0 ? "jpeg" : "png";
+	g_free (format_name);
+
+	dir = variants_get_dir ();
+	keep = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	n_monitors = gdk_display_get_n_monitors (display);
+	for (i = 0; i < n_monitors; i++) {
+		gint width, height, scale;
+		gdouble factor;
+		gchar *name, *path;
+		GdkMonitor *monitor;
+		GdkRectangle geometry;
+
+		monitor = gdk_display_get_monitor (display, i);
+		if (!monitor)
+			continue;
+
+		gdk_monitor_get_geometry (monitor, &geometry);
+		scale = gdk_monitor_get_scale_factor (monitor);
+
+		/* smallest size that still covers the monitor in device pixels */
+		factor = MAX ((gdouble) geometry.width * scale / src_width,
+                      (gdouble) geometry.height * scale / src_height);
+		if (factor >= 1.0)
+			continue;
+
+		width = MAX (1, (gint) (src_width * factor + 0.5));
+		height = MAX (1, (gint) (src_height * factor + 0.5));
+
+		name = g_strdup_printf ("%s-%dx%d.%s", key, width, height,
+                                g_str_equal (type, "jpeg") ? "jpg" : "png");
+		path = g_build_filename (dir, name, NULL);
+		g_free (name);
+
+		if (!g_file_test (path, G_FILE_TEST_EXISTS)) {
+			if (!pixbuf) {
+				GError *error = NULL;
+				pixbuf = gdk_pixbuf_new_from_file (source, &error);
+				if (!pixbuf) {
+					g_warning ("Could not decode %s: %s", source, error->message);
+					g_error_free (error);
+					g_free (path);
+					break;
+				}
+			}
+
+			if (!variant_write (pixbuf, width, height, type, path)) {
+				g_free (path);
+				continue;
+			}
+		}
+
+		g_hash_table_add (keep, g_strdup (path));
+
+		g_hash_table_replace (variants->monitors, variants_get_monitor_name (monitor, i), path);
+	}
+
+	/* variants of earlier wallpapers are not needed anymore */
+	variants_prune (dir, keep);
+
+	if (pixbuf)
+		g_object_unref (pixbuf);
+
+	g_hash_table_destroy (keep);
+	g_free (dir);
+	g_free (key);
+
+	return variants;
+}
+
+void
+wallpaper_variants_free (WallpaperVariants *variants)
+{
+	if (!variants)
+		return;
+
+	g_hash_table_destroy (variants->monitors);
+	g_free (variants->source);
+	g_free (variants);
+}
+
+/* the image for the monitor named in a /backdrop/screenN/monitorX/... property */
+const gchar *
+wallpaper_variants_lookup (WallpaperVariants *variants, const gchar *property)
+{
+	g_return_val_if_fail (variants != NULL && property != NULL, NULL);
+
+	const gchar *path = NULL;
+	gchar **tokens;
+
+	tokens = g_strsplit (property, "/", -1);
+	if (g_strv_length (tokens) > 3 && g_str_has_prefix (tokens[3], "monitor"))
+		path = g_hash_table_lookup (variants->monitors, tokens[3]);
+	g_strfreev (tokens);
+
+	return path ? path : variants->source;
+}
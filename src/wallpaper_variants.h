@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __WALLPAPER_VARIANTS_H__
+#define	__WALLPAPER_VARIANTS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _WallpaperVariants WallpaperVariants;
+
+WallpaperVariants *wallpaper_variants_new     (const gchar       *source);
+
+void               wallpaper_variants_free    (WallpaperVariants *variants);
+
+const gchar       *wallpaper_variants_lookup  (WallpaperVariants *variants,
+                                               const gchar       *property);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,460 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include <xfconf/xfconf.h>
+
+#include "metrics.h"
+#include "replay_trace.h"
+#include "xfconf_writer.h"
+
+
+/*
+ * Writes to xfconf go through one writer per channel. It remembers the
+ * values it has seen, follows property-changed for the rest of the
+ * process lifetime, and stages only the writes that change something.
+ * xfconfd takes one property per call, so xfconf_writer_commit () sends
+ * the staged writes back to back rather than in a single message; every
+ * write it saves is still one round trip and one redraw less.
+ *
+ * During an offline replay there is no xfconfd: a writer starts from
+ * the channel's file under the replay's $XDG_CONFIG_HOME, as xfconfd
+ * would, and its commits go to the replay trace.
+ */
+struct _XfconfWriter {
+	gchar         *name;
+	XfconfChannel *channel;
+	GHashTable    *values;
+	GHashTable    *pending;
+	GHashTable    *loaded;
+};
+
+typedef struct {
+	XfconfWriter *writer;
+	GString      *path;
+} ChannelFileParser;
+
+
+static GHashTable *writers = NULL;
+
+
+
+
+static GValue *
+value_dup (const GValue *src)
+{
+	GValue *value = g_new0 (GValue, 1);
+
+	g_value_init (value, G_VALUE_TYPE (src));
+	g_value_copy (src, value);
+
+	return value;
+}
+
+static void
+value_free (GValue *value)
+{
+	g_value_unset (value);
+	g_free (value);
+}
+
+static gboolean
+value_equal (const GValue *a, const GValue *b)
+{
+	if (G_VALUE_TYPE (a) != G_VALUE_TYPE (b))
+		return FALSE;
+
+	switch (G_VALUE_TYPE (a)) {
+		case G_TYPE_STRING:
+			return (g_strcmp0 (g_value_get_string (a), g_value_get_string (b)) == 0);
+		case G_TYPE_UINT:
+			return (g_value_get_uint (a) == g_value_get_uint (b));
+		case G_TYPE_INT:
+			return (g_value_get_int (a) == g_value_get_int (b));
+		case G_TYPE_BOOLEAN:
+			return (g_value_get_boolean (a) == g_value_get_boolean (b));
+		default:
+			/* unknown types are always written */
+			return FALSE;
+	}
+}
+
+static void
+property_changed_cb (XfconfChannel *channel,
+                     const gchar   *property,
+                     const GValue  *value,
+                     gpointer       data)
+{
+	XfconfWriter *writer = (XfconfWriter *)data;
+
+	if (G_IS_VALUE (value) && G_VALUE_TYPE (value) != G_TYPE_INVALID) {
+		g_hash_table_replace (writer->values, g_strdup (property), value_dup (value));
+	} else {
+		g_hash_table_remove (writer->values, property);
+	}
+}
+
+/* <property name="..." type="..." value="..."> nests like the property path */
+static void
+channel_file_start_element (GMarkupParseContext  *context,
+                            const gchar          *element_name,
+                            const gchar         **attribute_names,
+                            const gchar         **attribute_values,
+                            gpointer              data,
+                            GError              **error)
+{
+	ChannelFileParser *parser = (ChannelFileParser *)data;
+	const gchar *name = NULL, *type = NULL, *value = NULL;
+	GValue *v;
+	guint i;
+
+	if (!g_str_equal (element_name, "property"))
+		return;
+
+	for (i = 0; attribute_names[i]; i++) {
+		if (g_str_equal (attribute_names[i], "name"))
+			name = attribute_values[i];
+		else if (g_str_equal (attribute_names[i], "type"))
+			type = attribute_values[i];
+		else if (g_str_equal (attribute_names[i], "value"))
+			value = attribute_values[i];
+	}
+
+	g_string_append_c (parser->path, '/');
+	g_string_append (parser->path, name ? name : "");
+
+	if (!type || !value)
+		return;
+
+	v = g_new0 (GValue, 1);
+
+	if (g_str_equal (type, "string")) {
+		g_value_init (v, G_TYPE_STRING);
+		g_value_set_string (v, value);
+	} else if (g_str_equal (type, "uint")) {
+		g_value_init (v, G_TYPE_UINT);
+		g_value_set_uint (v, (guint) g_ascii_strtoull (value, NULL, 10));
+	} else if (g_str_equal (type, "int")) {
+		g_value_init (v, G_TYPE_INT);
+		g_value_set_int (v, (gint) g_ascii_strtoll (value, NULL, 10));
+	} else if (g_str_equal (type, "bool")) {
+		g_value_init (v, G_TYPE_BOOLEAN);
+		g_value_set_boolean (v, g_str_equal (value, "true"));
+	} else {
+		/* nothing this program writes */
+		g_free (v);
+		return;
+	}
+
+	g_hash_table_replace (parser->writer->values, g_strdup (parser->path->str), v);
+}
+
+static void
+channel_file_end_element (GMarkupParseContext  *context,
+                          const gchar          *element_name,
+                          gpointer              data,
+                          GError              **error)
+{
+	ChannelFileParser *parser = (ChannelFileParser *)data;
+	const gchar *slash;
+
+	if (!g_str_equal (element_name, "property"))
+		return;
+
+	slash = strrchr (parser->path->str, '/');
+	if (slash)
+		g_string_truncate (parser->path, slash - parser->path->str);
+}
+
+/* the values a replay starts from; a missing file is an empty channel */
+static void
+channel_file_load (XfconfWriter *writer)
+{
+	gchar *file, *name, *data = NULL;
+	gsize len = 0;
+	GError *error = NULL;
+	GMarkupParseContext *context;
+	GMarkupParser markup_parser = {
+		channel_file_start_element,
+		channel_file_end_element,
+		NULL, NULL, NULL
+	};
+	ChannelFileParser parser;
+
+	name = g_strdup_printf ("%s.xml", writer->name);
+	file = g_build_filename (g_get_user_config_dir (), "xfce4", "xfconf",
+                             "xfce-perchannel-xml", name, NULL);
+	g_free (name);
+
+	if (!g_file_get_contents (file, &data, &len, NULL)) {
+		g_free (file);
+		return;
+	}
+
+	parser.writer = writer;
+	parser.path = g_string_new (NULL);
+
+	context = g_markup_parse_context_new (&markup_parser, 0, &parser, NULL);
+	if (!g_markup_parse_context_parse (context, data, len, &error) ||
+        !g_markup_parse_context_end_parse (context, &error)) {
+		g_warning ("Could not read %s: %s", file, error->message);
+		g_error_free (error);
+	}
+	g_markup_parse_context_free (context);
+
+	g_string_free (parser.path, TRUE);
+	g_free (data);
+	g_free (file);
+}
+
+static void
+channel_trace_set (XfconfWriter *writer, const gchar *property, const GValue *value)
+{
+	gchar *target;
+	GValue str = G_VALUE_INIT;
+
+	g_value_init (&str, G_TYPE_STRING);
+	g_value_transform (value, &str);
+
+	target = g_strdup_printf ("%s:%s", writer->name, property);
+	replay_trace_record ("xfconf", target, g_value_get_string (&str));
+	g_free (target);
+
+	g_value_unset (&str);
+}
+
+static void
+xfconf_writer_free (XfconfWriter *writer)
+{
+	if (writer->channel) {
+		g_signal_handlers_disconnect_by_func (writer->channel, property_changed_cb, writer);
+		g_object_unref (writer->channel);
+	}
+	g_free (writer->name);
+	g_hash_table_destroy (writer->values);
+	g_hash_table_destroy (writer->pending);
+	g_hash_table_destroy (writer->loaded);
+	g_free (writer);
+}
+
+/* the cached value of property, fetched once if not known yet */
+static const GValue *
+xfconf_writer_lookup (XfconfWriter *writer, const gchar *property)
+{
+	GValue value = G_VALUE_INIT;
+	GValue *cached;
+
+	cached = g_hash_table_lookup (writer->values, property);
+	if (cached || !writer->channel)
+		return cached;
+
+	if (!xfconf_channel_get_property (writer->channel, property, &value))
+		return NULL;
+
+	cached = value_dup (&value);
+	g_value_unset (&value);
+	g_hash_table_insert (writer->values, g_strdup (property), cached);
+
+	return cached;
+}
+
+static void
+xfconf_writer_stage (XfconfWriter *writer, const gchar *property, GValue *value)
+{
+	const GValue *current = xfconf_writer_lookup (writer, property);
+
+	if (current && value_equal (current, value)) {
+		/* an earlier staged write may have to be taken back */
+		g_hash_table_remove (writer->pending, property);
+		value_free (value);
+		metrics_count ("xfconf.writes_skipped", 1);
+		return;
+	}
+
+	g_hash_table_replace (writer->pending, g_strdup (property), value);
+}
+
+XfconfWriter *
+xfconf_writer_get (const gchar *channel_name)
+{
+	g_return_val_if_fail (channel_name != NULL, NULL);
+
+	XfconfWriter *writer;
+
+	if (!writers) {
+		writers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) xfconf_writer_free);
+	}
+
+	writer = g_hash_table_lookup (writers, channel_name);
+	if (writer)
+		return writer;
+
+	writer = g_new0 (XfconfWriter, 1);
+	writer->name = g_strdup (channel_name);
+	writer->values = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, (GDestroyNotify) value_free);
+	writer->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, (GDestroyNotify) value_free);
+	writer->loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (replay_trace_is_active ()) {
+		channel_file_load (writer);
+	} else {
+		writer->channel = xfconf_channel_new (channel_name);
+		g_signal_connect (writer->channel, "property-changed",
+                          G_CALLBACK (property_changed_cb), writer);
+	}
+
+	g_hash_table_insert (writers, g_strdup (channel_name), writer);
+
+	return writer;
+}
+
+/* pending writes are dropped; call before xfconf_shutdown () */
+void
+xfconf_writer_shutdown (void)
+{
+	if (writers) {
+		g_hash_table_destroy (writers);
+		writers = NULL;
+	}
+}
+
+/* fetches everything below property_base in one call, once */
+void
+xfconf_writer_load (XfconfWriter *writer, const gchar *property_base)
+{
+	g_return_if_fail (writer != NULL && property_base != NULL);
+
+	GHashTable *table;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (!writer->channel || g_hash_table_contains (writer->loaded, property_base))
+		return;
+
+	table = xfconf_channel_get_properties (writer->channel, property_base);
+	if (!table)
+		return;
+
+	g_hash_table_iter_init (&iter, table);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_hash_table_replace (writer->values, g_strdup (key), value_dup (value));
+	}
+	g_hash_table_destroy (table);
+
+	g_hash_table_add (writer->loaded, g_strdup (property_base));
+}
+
+/* sorted names of the cached properties below property_base */
+GList *
+xfconf_writer_list_properties (XfconfWriter *writer, const gchar *property_base)
+{
+	g_return_val_if_fail (writer != NULL && property_base != NULL, NULL);
+
+	GList *properties = NULL;
+	GHashTableIter iter;
+	gpointer key;
+	gsize len = strlen (property_base);
+
+	g_hash_table_iter_init (&iter, writer->values);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		const gchar *property = (const gchar *)key;
+		if (strncmp (property, property_base, len) == 0 &&
+            (property[len] == '/' || property[len] == '\0'))
+			properties = g_list_prepend (properties, (gpointer) property);
+	}
+
+	return g_list_sort (properties, (GCompareFunc) g_strcmp0);
+}
+
+void
+xfconf_writer_set_string (XfconfWriter *writer, const gchar *property, const gchar *value)
+{
+	g_return_if_fail (writer != NULL && property != NULL);
+
+	GValue *v = g_new0 (GValue, 1);
+
+	g_value_init (v, G_TYPE_STRING);
+	g_value_set_string (v, value);
+
+	xfconf_writer_stage (writer, property, v);
+}
+
+void
+xfconf_writer_set_uint (XfconfWriter *writer, const gchar *property, guint value)
+{
+	g_return_if_fail (writer != NULL && property != NULL);
+
+	GValue *v = g_new0 (GValue, 1);
+
+	g_value_init (v, G_TYPE_UINT);
+	g_value_set_uint (v, value);
+
+	xfconf_writer_stage (writer, property, v);
+}
+
+/* sends the staged writes in property order; returns how many were sent */
+guint
+xfconf_writer_commit (XfconfWriter *writer)
+{
+	g_return_val_if_fail (writer != NULL, 0);
+
+	guint n_written = 0;
+	GList *properties, *l;
+	GHashTable *pending;
+
+	pending = writer->pending;
+	writer->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, (GDestroyNotify) value_free);
+
+	properties = g_list_sort (g_hash_table_get_keys (pending), (GCompareFunc) g_strcmp0);
+
+	for (l = properties; l; l = l->next) {
+		const gchar *property = (const gchar *)l->data;
+		const GValue *value = g_hash_table_lookup (pending, property);
+
+		if (!writer->channel) {
+			channel_trace_set (writer, property, value);
+			g_hash_table_replace (writer->values, g_strdup (property), value_dup (value));
+			n_written++;
+		} else if (xfconf_channel_set_property (writer->channel, property, value)) {
+			g_hash_table_replace (writer->values, g_strdup (property), value_dup (value));
+			n_written++;
+		} else {
+			g_warning ("Failed to set %s", property);
+		}
+	}
+
+	g_list_free (properties);
+	g_hash_table_destroy (pending);
+
+	metrics_count ("xfconf.writes", n_written);
+
+	return n_written;
+}
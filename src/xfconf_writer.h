@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef __XFCONF_WRITER_H__
+#define	__XFCONF_WRITER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _XfconfWriter XfconfWriter;
+
+XfconfWriter *xfconf_writer_get              (const gchar  *channel_name);
+
+void          xfconf_writer_shutdown         (void);
+
+void          xfconf_writer_load             (XfconfWriter *writer,
+                                              const gchar  *property_base);
+
+GList        *xfconf_writer_list_properties  (XfconfWriter *writer,
+                                              const gchar  *property_base);
+
+void          xfconf_writer_set_string       (XfconfWriter *writer,
+                                              const gchar  *property,
+                                              const gchar  *value);
+
+void          xfconf_writer_set_uint         (XfconfWriter *writer,
+                                              const gchar  *property,
+                                              guint         value);
+
+guint         xfconf_writer_commit           (XfconfWriter *writer);
+
+G_END_DECLS
+
+#endif